@@ -0,0 +1,277 @@
+/**
+ * @file bench_kernels.cpp
+ * @brief Measures the time per call of the geometry and material kernels the renderer spends its time in
+ *
+ * Usage: `bench_kernels [filter] [milliseconds]`
+ *
+ * Every benchmark runs over a fixed set of rays built from a fixed seed, and random_double is
+ * seeded the same way before each one, so two builds see exactly the same inputs. Each benchmark is
+ * timed in 5 rounds of at least `milliseconds` (50 by default), and the fastest round is reported
+ * in nanoseconds per operation. Only benchmarks whose name contains `filter` are run.
+ *
+ * The sampler benchmarks time one get_2d call, including a share of the start_sample calls.
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "util/rtweekend.h"
+#include "geometry/hittable.h"
+#include "geometry/hittable_list.h"
+#include "geometry/sphere.h"
+#include "geometry/triangle.h"
+#include "geometry/material.h"
+#include "geometry/onb.h"
+#include "geometry/sampling.h"
+#include "util/sampler.h"
+
+using namespace std::chrono;
+
+/**
+ * @brief Keeps the compiler from removing a computation whose result is otherwise unused
+ */
+template <typename T>
+inline void do_not_optimize(const T& value) {
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+/**
+ * @brief Small deterministic generator for the inputs, independent from random_double
+ */
+class input_generator {
+  public:
+    input_generator(uint64_t seed) : state(seed) {}
+
+    double next() {
+        state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+        return (state >> 11) * (1.0 / 9007199254740992.0);
+    }
+
+    double next(double min, double max) { return min + (max - min) * next(); }
+
+    vec3 next_vec3(double min, double max) { return vec3(next(min, max), next(min, max), next(min, max)); }
+
+    vec3 next_unit_vector() {
+        while (true) {
+            vec3 p = next_vec3(-1, 1);
+            if (p.length_squared() < 1 && p.length_squared() > 1e-6) return unit_vector(p);
+        }
+    }
+
+  private:
+    uint64_t state;
+};
+
+/**
+ * @return rays starting on a sphere of radius 5 and aimed at points in a box of half size
+ * `spread` around the origin, so some hit a unit object there and some miss
+ */
+std::vector<ray> make_rays(size_t count, double spread, uint64_t seed = 2023) {
+    input_generator gen(seed);
+    std::vector<ray> rays;
+    rays.reserve(count);
+    for (size_t k = 0; k < count; k++) {
+        point3 origin = 5.0 * gen.next_unit_vector();
+        point3 target = gen.next_vec3(-spread, spread);
+        rays.push_back(ray(origin, target - origin));
+    }
+    return rays;
+}
+
+/**
+ * @return hit records on a unit sphere at the origin, seen by the given rays
+ */
+std::vector<hit_record> make_hits(const std::vector<ray>& rays, shared_ptr<material> mat) {
+    std::vector<hit_record> hits;
+    for (const ray& r : rays) {
+        hit_record rec;
+        rec.p = unit_vector(r.origin());
+        rec.set_face_normal(r, rec.p);
+        rec.mat = mat;
+        rec.t = 1;
+        hits.push_back(rec);
+    }
+    return hits;
+}
+
+const size_t batch = 1024; // Operations per call of a benchmark body
+std::string filter;
+double min_round_ms = 50;
+
+/**
+ * @brief Times body, which performs `batch` operations per call, and prints the ns per operation
+ */
+template <typename Body>
+void run(const std::string& name, Body body) {
+    if (!filter.empty() && name.find(filter) == std::string::npos) return;
+
+    seed_random(1);
+    body(); // Warm up
+
+    // Find how many calls fill a round
+    size_t calls = 1;
+    while (true) {
+        auto start = steady_clock::now();
+        for (size_t c = 0; c < calls; c++) body();
+        double elapsed = duration<double, std::milli>(steady_clock::now() - start).count();
+        if (elapsed >= min_round_ms || calls >= (size_t(1) << 30)) break;
+        calls *= elapsed > 0 ? std::max<size_t>(2, static_cast<size_t>(min_round_ms / elapsed)) : 2;
+    }
+
+    double best = 1e30;
+    for (int round = 0; round < 5; round++) {
+        seed_random(1);
+        auto start = steady_clock::now();
+        for (size_t c = 0; c < calls; c++) body();
+        double ns = duration<double, std::nano>(steady_clock::now() - start).count() / (calls * batch);
+        if (ns < best) best = ns;
+    }
+
+    std::printf("%-36s %10.2f ns/op %10.2f Mops/s\n", name.c_str(), best, 1e3 / best);
+}
+
+int main(int argc, char* argv[]) {
+    if (argc > 1) filter = argv[1];
+    if (argc > 2) min_round_ms = std::atof(argv[2]);
+
+    const std::vector<ray> rays = make_rays(batch, 1.5);
+    const interval ray_t(0.001, infinity);
+
+    auto diffuse = make_shared<lambertian>(color(0.5, 0.0, 0.0));
+    auto gold    = make_shared<metal>(color(0.8, 0.6, 0.2), 0.3);
+    auto glass   = make_shared<dielectric>(1.5);
+
+    // Intersection kernels
+    sphere ball(point3(0, 0, 0), 1.0, diffuse);
+    run("sphere::hit", [&]() {
+        hit_record rec;
+        for (const ray& r : rays) do_not_optimize(ball.hit(r, ray_t, rec));
+    });
+    run("sphere::occluded", [&]() {
+        for (const ray& r : rays) do_not_optimize(ball.occluded(r, ray_t));
+    });
+
+    triangle tri(mat3(vec3(-1, -1, 0), vec3(1, -1, 0), vec3(0, 1.2, 0)),
+                 mat3(vec3(0, 0, 1), vec3(0, 0, 1), vec3(0, 0, 1)), diffuse);
+    run("triangle::hit", [&]() {
+        hit_record rec;
+        for (const ray& r : rays) do_not_optimize(tri.hit(r, ray_t, rec));
+    });
+    run("triangle::occluded", [&]() {
+        for (const ray& r : rays) do_not_optimize(tri.occluded(r, ray_t));
+    });
+
+    // The same rays, skipping back faces
+    std::vector<ray> culling;
+    for (const ray& r : rays) culling.push_back(ray(r.origin(), r.direction(), ray_camera, ray_cull_back_faces));
+    run("triangle::hit/cull", [&]() {
+        hit_record rec;
+        for (const ray& r : culling) do_not_optimize(tri.hit(r, ray_t, rec));
+    });
+
+    for (int size : {1, 4, 16, 64, 256}) {
+        // Small spheres spread through the box the rays aim at
+        input_generator gen(size);
+        hittable_list list;
+        for (int k = 0; k < size; k++)
+            list.add(make_shared<sphere>(gen.next_vec3(-1.5, 1.5), 0.1 + 0.3 * gen.next(), diffuse));
+
+        run("hittable_list::hit/" + std::to_string(size), [&]() {
+            hit_record rec;
+            for (const ray& r : rays) do_not_optimize(list.hit(r, ray_t, rec));
+        });
+        run("hittable_list::occluded/" + std::to_string(size), [&]() {
+            for (const ray& r : rays) do_not_optimize(list.occluded(r, ray_t));
+        });
+    }
+
+    // vec3 operations
+    std::vector<vec3> a, b;
+    input_generator gen(7);
+    for (size_t k = 0; k < batch; k++) {
+        a.push_back(gen.next_vec3(-1, 1));
+        b.push_back(gen.next_vec3(-1, 1));
+    }
+    run("vec3 dot", [&]() {
+        for (size_t k = 0; k < batch; k++) do_not_optimize(dot(a[k], b[k]));
+    });
+    run("vec3 cross", [&]() {
+        for (size_t k = 0; k < batch; k++) do_not_optimize(cross(a[k], b[k]));
+    });
+    run("vec3 unit_vector", [&]() {
+        for (size_t k = 0; k < batch; k++) do_not_optimize(unit_vector(a[k]));
+    });
+    run("vec3 reflect", [&]() {
+        for (size_t k = 0; k < batch; k++) do_not_optimize(reflect(a[k], b[k]));
+    });
+    run("random_unit_vector", [&]() {
+        for (size_t k = 0; k < batch; k++) do_not_optimize(random_unit_vector());
+    });
+
+    // Direction samplers, one direction per pair of numbers
+    std::vector<double> u1(batch), u2(batch), dx(batch), dy(batch), dz(batch);
+    for (size_t k = 0; k < batch; k++) {
+        u1[k] = gen.next();
+        u2[k] = gen.next();
+    }
+    run("uniform_sphere", [&]() {
+        for (size_t k = 0; k < batch; k++) do_not_optimize(uniform_sphere(u1[k], u2[k]));
+    });
+    run("uniform_sphere_batch", [&]() {
+        uniform_sphere_batch(batch, u1.data(), u2.data(), dx.data(), dy.data(), dz.data());
+        do_not_optimize(dx[0]);
+    });
+    run("cosine_hemisphere", [&]() {
+        for (size_t k = 0; k < batch; k++) do_not_optimize(cosine_hemisphere(u1[k], u2[k]));
+    });
+    run("cosine_hemisphere_batch", [&]() {
+        cosine_hemisphere_batch(batch, u1.data(), u2.data(), dx.data(), dy.data(), dz.data());
+        do_not_optimize(dx[0]);
+    });
+    run("ggx_normal", [&]() {
+        for (size_t k = 0; k < batch; k++) do_not_optimize(ggx_normal(u1[k], u2[k], 0.3));
+    });
+    run("ggx_normal_batch", [&]() {
+        ggx_normal_batch(batch, u1.data(), u2.data(), 0.3, dx.data(), dy.data(), dz.data());
+        do_not_optimize(dx[0]);
+    });
+    run("onb + cosine_hemisphere", [&]() {
+        for (size_t k = 0; k < batch; k++) do_not_optimize(onb(unit_vector(a[k])).local(cosine_hemisphere(u1[k], u2[k])));
+    });
+
+    // Samplers, drawing 8 dimensions per sample
+    const char* sampler_names[] = {"independent", "sobol", "halton", "blue_noise"};
+    for (int kind = sampler_independent; kind <= sampler_blue_noise; kind++) {
+        std::unique_ptr<sampler> pixel_sampler = make_sampler(static_cast<sampler_kind>(kind), 1);
+        pixel_sampler->start_sample(0, 0, 0);
+        run(std::string("sampler get_2d/") + sampler_names[kind], [&]() {
+            for (size_t k = 0; k < batch; k += 8) {
+                pixel_sampler->start_sample(static_cast<int>(k & 63), 0, static_cast<int>(k));
+                for (int d = 0; d < 8; d++) do_not_optimize(pixel_sampler->get_2d());
+            }
+        });
+    }
+
+    // Materials, scattering from hits on a unit sphere
+    const std::vector<hit_record> hits = make_hits(rays, diffuse);
+    const std::vector<shared_ptr<material>> materials = {diffuse, gold, glass};
+    independent_sampler samples(1);
+    const char* names[] = {"lambertian::scatter", "metal::scatter", "dielectric::scatter"};
+    for (size_t m = 0; m < materials.size(); m++) {
+        const material& mat = *materials[m];
+        run(names[m], [&]() {
+            color attenuation;
+            ray scattered;
+            for (size_t k = 0; k < batch; k++) {
+                do_not_optimize(mat.scatter(rays[k], hits[k], attenuation, scattered, samples));
+                do_not_optimize(scattered);
+            }
+        });
+    }
+
+    return 0;
+}
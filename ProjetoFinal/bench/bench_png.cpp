@@ -0,0 +1,95 @@
+/**
+ * @file bench_png.cpp
+ * @brief Compares the single threaded stb_image_write PNG encoder with the parallel stripe encoder
+ *
+ * Usage: `bench_png [width] [height] [repetitions] [threads] [level]`
+ *
+ * Both encoders compress the same synthetic frame (smooth shading, hard edges and sampling noise,
+ * like a path traced image) at the same compression level. The best time of all repetitions is
+ * reported for each one, together with the encoded size.
+ */
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#include "util/rtweekend.h"
+#include "export_image.cpp"
+
+using namespace std::chrono;
+
+/**
+ * @brief Fills a framebuffer with a deterministic render-like pattern
+ */
+void fill_test_image(framebuffer& image) {
+    unsigned int state = 12345;
+    for (int j = 0; j < image.get_height(); j++) {
+        for (int i = 0; i < image.get_width(); i++) {
+            double u = double(i) / image.get_width();
+            double v = double(j) / image.get_height();
+
+            // Sky gradient, a shaded disc and a checkered floor
+            color c = (1.0 - v) * color(0.5, 0.7, 1.0) + v * color(1.0, 1.0, 1.0);
+            double dx = u - 0.5, dy = v - 0.45;
+            if (dx * dx + dy * dy < 0.04)
+                c = color(0.8, 0.2, 0.1) * (0.3 + 0.7 * (0.2 - dy) / 0.4);
+            else if (v > 0.7)
+                c = ((int(u * 40) + int(v * 40)) % 2) ? color(0.2, 0.2, 0.3) : color(0.4, 0.4, 0.5);
+
+            // Monte Carlo like noise
+            state = state * 1664525u + 1013904223u;
+            double noise = ((state >> 8) & 0xff) / 255.0 - 0.5;
+            c += 0.06 * color(noise, noise, noise);
+
+            unsigned char* p = image.pixel(i, j);
+            color_to_bytes(c, 1, p);
+        }
+    }
+}
+
+template <typename Encode>
+double best_time_ms(int repetitions, size_t& size, Encode encode) {
+    double best = 1e30;
+    for (int r = 0; r < repetitions; r++) {
+        auto start = steady_clock::now();
+        size = encode();
+        double elapsed = duration<double, std::milli>(steady_clock::now() - start).count();
+        if (elapsed < best) best = elapsed;
+    }
+    return best;
+}
+
+int main(int argc, char* argv[]) {
+    int width       = argc > 1 ? std::atoi(argv[1]) : 7680;
+    int height      = argc > 2 ? std::atoi(argv[2]) : 4320;
+    int repetitions = argc > 3 ? std::atoi(argv[3]) : 3;
+    int threads     = argc > 4 ? std::atoi(argv[4]) : 0;
+    int level       = argc > 5 ? std::atoi(argv[5]) : stbi_write_png_compression_level;
+
+    framebuffer image(width, height);
+    fill_test_image(image);
+    stbi_write_png_compression_level = level;
+
+    size_t stb_size = 0, parallel_size = 0;
+
+    double stb_ms = best_time_ms(repetitions, stb_size, [&]() {
+        int length = 0;
+        unsigned char* png = stbi_write_png_to_mem(image.data(), image.stride(), width, height, 3, &length);
+        STBIW_FREE(png);
+        return static_cast<size_t>(length);
+    });
+
+    double parallel_ms = best_time_ms(repetitions, parallel_size, [&]() {
+        return encode_png_parallel(image, threads, level).size();
+    });
+
+    int used_threads = threads > 0 ? threads : static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+
+    std::cout << "Image: " << width << "x" << height << ", compression level " << level << std::endl;
+    std::cout << "stb_image_write:  " << stb_ms << " ms, " << stb_size << " bytes" << std::endl;
+    std::cout << "parallel (" << used_threads << " threads): " << parallel_ms << " ms, " << parallel_size << " bytes" << std::endl;
+    std::cout << "Speedup: " << stb_ms / parallel_ms << "x, size ratio: " << double(parallel_size) / stb_size << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,573 @@
+/**
+ * @file bench_render.cpp
+ * @brief Renders the project's scenes end to end and compares the results with a stored baseline
+ *
+ * Usage: `bench_render [options]`
+ *
+ * - `--scene <projeto_final|atividade05|stress|lights|all>` the scenes to render (all by default,
+ *   which leaves out stress and lights)
+ * - `--stress <spheres>,<stars>,<triangles>` the size of the stress scene (100,10,10000)
+ * - `--frames <list>` comma separated animation frames to render (0 by default)
+ * - `--width <pixels>`, `--spp <samples>`, `--depth <bounces>` override every camera (320, 16, 50)
+ * - `--seed <n>` the seed of the random numbers, the camera seed is seed + frame (1)
+ * - `--threads <n>` the rendering threads, 0 for one per hardware thread (0)
+ * - `--tile <pixels>` the side of the tiles handed to the threads (32)
+ * - `--adaptive <min spp>,<noise>` samples adaptively, with --spp as the maximum (off)
+ * - `--progressive <milliseconds>,<noise>` renders in progressive passes with the given budget and
+ *   target noise, 0 for no limit (off)
+ * - `--sampler <independent|sobol|halton|blue_noise>` the sequence of the sample values (independent)
+ * - `--no-light-sampling` finds the lights only by bouncing, without shadow rays
+ * - `--cull-back-faces` makes rays outside every object skip back faces
+ * - `--denoise` filters every image with the camera's denoiser, included in the time
+ * - `--temporal` carries the samples of each frame over to the next selected frame of the same
+ *   camera, so the frames should be consecutive (see temporal_accumulator); every repeat of a
+ *   frame starts from the same history
+ * - `--aovs` also records the depth, normal, albedo, position and ids the camera rays hit first,
+ *   as for saving them, included in the time
+ * - `--scaling <n>` renders the first selected image at 1, 2, 4 ... n threads instead
+ * - `--repeat <n>` renders every frame n times and keeps the fastest (1)
+ * - `--json <file>` writes the results as JSON
+ * - `--images <dir>` compares every image with `<dir>/<name>.ppm` (PSNR), saving it there first if missing
+ * - `--compare <baseline.json>` compares the results with a previous `--json` output
+ * - `--threshold <fraction>` the noise level of the comparison (0.05)
+ *
+ * Every camera of every selected scene renders every selected frame. For each one the wall time,
+ * rays per second, the mean samples per pixel actually taken, a checksum of the 8 bit image and, with `--images`, the PSNR against the stored
+ * image are reported, along with the peak resident memory of the process. With `--compare`, a
+ * frame whose time grew by more than the threshold, or whose image changed, is flagged, and the
+ * program exits with 1 if any frame regressed.
+ *
+ * With `--scaling`, the speedup and efficiency over one thread are reported for every thread
+ * count, with the busy and idle time of each thread, the tail of the render (the time from the
+ * first thread running out of tiles to the end) and the slowest tile, so that load imbalance from
+ * expensive regions shows up. The image must be the same at every thread count.
+ */
+
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <thread>
+
+#include <sys/resource.h>
+
+#include "util/rtweekend.h"
+#include "export_image.cpp"
+#include "scenes.h"
+#include "util/render_stats.h"
+
+#ifndef RESOURCE_DIR
+#define RESOURCE_DIR "../resources"
+#endif
+
+using namespace std::chrono;
+
+/**
+ * @brief The measurements of one rendered image
+ */
+struct bench_result {
+    std::string name;
+    double wall_ms = 0;
+    double rays_per_second = 0;
+    uint64_t rays = 0;
+    double mean_spp = 0;
+    std::string checksum;
+    double psnr = -1; // Negative when there is no stored image to compare with
+    long peak_rss_kb = 0;
+};
+
+/**
+ * @brief The measurements of one image rendered with a given number of threads
+ */
+struct scaling_result {
+    int threads = 1;
+    double wall_ms = 0;
+    double speedup = 1;
+    double efficiency = 1; // Speedup per thread
+    std::string checksum;
+    render_profile profile;
+};
+
+/**
+ * @return the peak resident set size of the process, in kilobytes
+ */
+long peak_rss_kb() {
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+/**
+ * @return the 64 bit FNV-1a hash of the image bytes, in hexadecimal
+ */
+std::string image_checksum(const framebuffer& image) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t k = 0; k < image.size(); k++) {
+        hash ^= image.data()[k];
+        hash *= 1099511628211ULL;
+    }
+    char text[17];
+    std::snprintf(text, sizeof(text), "%016llx", static_cast<unsigned long long>(hash));
+    return text;
+}
+
+/**
+ * @brief Reads a binary P6 PPM file as written by saveToP6
+ *
+ * @return false if the file does not exist or is not a P6 PPM with 255 as maximum value
+ */
+bool read_p6(const std::string& filename, framebuffer& image) {
+    std::ifstream in(filename, std::ios::binary);
+    std::string magic;
+    int width, height, max_value;
+    if (!(in >> magic >> width >> height >> max_value) || magic != "P6" || max_value != 255)
+        return false;
+    in.get(); // Single whitespace before the pixels
+    image.resize(width, height);
+    in.read(reinterpret_cast<char*>(image.data()), image.size());
+    return static_cast<bool>(in);
+}
+
+/**
+ * @return the peak signal to noise ratio between two 8 bit images of the same size, in dB
+ */
+double psnr(const framebuffer& a, const framebuffer& b) {
+    double squared_error = 0;
+    for (size_t k = 0; k < a.size(); k++) {
+        double difference = double(a.data()[k]) - b.data()[k];
+        squared_error += difference * difference;
+    }
+    if (squared_error == 0) return INFINITY;
+    double mse = squared_error / a.size();
+    return 10 * std::log10(255.0 * 255.0 / mse);
+}
+
+/**
+ * @return the value of `"key":` in a line of the JSON written by write_json, or an empty string
+ */
+std::string json_field(const std::string& line, const std::string& key) {
+    std::string pattern = "\"" + key + "\":";
+    size_t start = line.find(pattern);
+    if (start == std::string::npos) return "";
+    start += pattern.size();
+    if (line[start] == '"') {
+        size_t end = line.find('"', start + 1);
+        return line.substr(start + 1, end - start - 1);
+    }
+    size_t end = line.find_first_of(",}", start);
+    return line.substr(start, end - start);
+}
+
+void write_json(const std::string& filename, const std::string& config, const std::vector<bench_result>& results,
+                const std::vector<scaling_result>& scaling, double total_ms) {
+    std::ofstream out(filename);
+    if (!out) {
+        std::cerr << "Error: Could not open " << filename << std::endl;
+        return;
+    }
+
+    // One result per line, so compare can read the file back line by line
+    out << "{\"config\":" << config << ",\n\"results\":[\n";
+    for (size_t k = 0; k < results.size(); k++) {
+        const bench_result& r = results[k];
+        out << "{\"name\":\"" << r.name << "\",\"wall_ms\":" << r.wall_ms << ",\"rays\":" << r.rays
+            << ",\"rays_per_second\":" << r.rays_per_second << ",\"mean_spp\":" << r.mean_spp << ",\"checksum\":\"" << r.checksum << "\"";
+        if (r.psnr >= 0)
+            out << ",\"psnr\":" << (std::isinf(r.psnr) ? 999.0 : r.psnr);
+        out << ",\"peak_rss_kb\":" << r.peak_rss_kb << "}" << (k + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "],\n\"scaling\":[\n";
+    for (size_t k = 0; k < scaling.size(); k++) {
+        const scaling_result& r = scaling[k];
+        tile_time slowest = r.profile.slowest_tile();
+        out << "{\"threads\":" << r.threads << ",\"wall_ms\":" << r.wall_ms << ",\"speedup\":" << r.speedup
+            << ",\"efficiency\":" << r.efficiency << ",\"tail_ms\":" << r.profile.tail_ms
+            << ",\"slowest_tile_ms\":" << slowest.ms << ",\"slowest_tile\":[" << slowest.x << "," << slowest.y
+            << "],\"checksum\":\"" << r.checksum << "\",\"busy_ms\":[";
+        for (int t = 0; t < r.profile.thread_count(); t++)
+            out << (t ? "," : "") << r.profile.busy_ms[t];
+        out << "]}" << (k + 1 < scaling.size() ? "," : "") << "\n";
+    }
+    out << "],\n\"total_wall_ms\":" << total_ms << ",\"peak_rss_kb\":" << peak_rss_kb() << "}\n";
+}
+
+/**
+ * @brief Compares the results with a baseline file written by write_json
+ *
+ * @return the number of regressions found
+ */
+int compare(const std::string& filename, const std::vector<bench_result>& results, double threshold) {
+    std::ifstream in(filename);
+    if (!in) {
+        std::cerr << "Error: Could not open " << filename << std::endl;
+        return 1;
+    }
+
+    std::map<std::string, std::string> baseline; // Result lines by name
+    std::string line;
+    while (std::getline(in, line)) {
+        std::string name = json_field(line, "name");
+        if (!name.empty()) baseline[name] = line;
+    }
+
+    int regressions = 0;
+    std::printf("\n%-32s %12s %12s %9s  %s\n", "Comparison", "base ms", "ms", "change", "status");
+    for (const bench_result& r : results) {
+        auto found = baseline.find(r.name);
+        if (found == baseline.end()) {
+            std::printf("%-32s %12s %12.1f %9s  not in baseline\n", r.name.c_str(), "-", r.wall_ms, "-");
+            continue;
+        }
+
+        double base_ms = std::atof(json_field(found->second, "wall_ms").c_str());
+        long base_rss = std::atol(json_field(found->second, "peak_rss_kb").c_str());
+        double change = base_ms > 0 ? r.wall_ms / base_ms - 1 : 0;
+
+        std::string status = "ok";
+        if (change > threshold) {
+            status = "SLOWER";
+            regressions++;
+        } else if (change < -threshold) {
+            status = "faster";
+        }
+        if (json_field(found->second, "checksum") != r.checksum) {
+            status += ", image changed";
+            regressions++;
+        }
+        if (base_rss > 0 && r.peak_rss_kb > base_rss * (1 + threshold)) {
+            status += ", more memory (" + std::to_string(base_rss) + " -> " + std::to_string(r.peak_rss_kb) + " KB)";
+            regressions++;
+        }
+
+        std::printf("%-32s %12.1f %12.1f %+8.1f%%  %s\n", r.name.c_str(), base_ms, r.wall_ms, change * 100, status.c_str());
+    }
+    return regressions;
+}
+
+/**
+ * @brief Reads a sampler name as used on the command line
+ *
+ * @return false if the name is unknown
+ */
+bool parse_sampler(const std::string& name, sampler_kind& kind) {
+    if (name == "independent") kind = sampler_independent;
+    else if (name == "sobol") kind = sampler_sobol;
+    else if (name == "halton") kind = sampler_halton;
+    else if (name == "blue_noise") kind = sampler_blue_noise;
+    else return false;
+    return true;
+}
+
+/**
+ * @brief Renders the current frame of the camera at 1, 2, 4 ... max_threads threads, keeping the
+ * fastest of `repeat` renders at each count, and prints the scaling and load balance
+ *
+ * @return the results, with an empty list if the image changed with the number of threads
+ */
+std::vector<scaling_result> measure_scaling(camera& cam, const hittable& world, int max_threads, int repeat) {
+    std::vector<int> counts;
+    for (int n = 1; n < max_threads; n *= 2) counts.push_back(n);
+    counts.push_back(max_threads);
+
+    std::vector<scaling_result> results;
+    std::printf("%8s %12s %9s %11s %9s %10s %12s  %s\n", "threads", "ms", "speedup", "efficiency", "balance",
+                "tail ms", "slowest ms", "slowest tile");
+    for (int n : counts) {
+        scaling_result r;
+        r.threads = n;
+        r.wall_ms = 1e30;
+        cam.threads = n;
+        for (int k = 0; k < repeat; k++) {
+            cam.render(world);
+            if (cam.last_profile().wall_ms < r.wall_ms) {
+                r.wall_ms = cam.last_profile().wall_ms;
+                r.profile = cam.last_profile();
+            }
+        }
+        std::clog << "\r" << std::flush;
+        render_stats::collect();
+
+        r.checksum = image_checksum(cam.frame());
+        r.speedup = results.empty() ? 1 : results[0].wall_ms / r.wall_ms;
+        r.efficiency = r.speedup / n;
+
+        tile_time slowest = r.profile.slowest_tile();
+        std::printf("%8d %12.1f %9.2f %10.1f%% %8.1f%% %10.1f %12.2f  (%d, %d)\n", n, r.wall_ms, r.speedup,
+                    r.efficiency * 100, r.profile.balance() * 100, r.profile.tail_ms, slowest.ms, slowest.x, slowest.y);
+
+        if (!results.empty() && r.checksum != results[0].checksum) {
+            std::cerr << "Error: The image rendered with " << n << " threads differs from the one with 1 thread" << std::endl;
+            return {};
+        }
+        results.push_back(r);
+    }
+
+    std::printf("\n");
+    results.back().profile.write_summary(std::cout);
+    return results;
+}
+
+int main(int argc, char* argv[]) {
+    std::string scene_name = "all";
+    std::vector<int> frames = {0};
+    int width = 320, spp = 16, depth = 50, repeat = 1;
+    unsigned int seed = 1;
+    int threads = 0, tile = 32, scaling_threads = 0;
+    int min_spp = 0; // 0 when sampling is not adaptive
+    double noise = 0.01;
+    bool progressive = false;
+    std::string sampler_name = "independent";
+    sampler_kind sampling = sampler_independent;
+    double budget_ms = 0, target_noise = 0;
+    bool light_sampling = true;
+    bool cull_back_faces = false;
+    bool denoise = false;
+    bool temporal = false;
+    bool aovs = false;
+    double threshold = 0.05;
+    std::string json_path, images_dir, compare_path;
+    int stress_spheres = 100, stress_stars = 10;
+    long stress_triangles = 10000;
+
+    for (int a = 1; a < argc; a++) {
+        std::string arg = argv[a];
+        bool has_value = a + 1 < argc;
+        if (arg == "--scene" && has_value) {
+            scene_name = argv[++a];
+        } else if (arg == "--stress" && has_value) {
+            if (std::sscanf(argv[++a], "%d,%d,%ld", &stress_spheres, &stress_stars, &stress_triangles) != 3) {
+                std::cerr << "Error: --stress expects <spheres>,<stars>,<triangles>" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--frames" && has_value) {
+            frames.clear();
+            std::stringstream list(argv[++a]);
+            std::string item;
+            while (std::getline(list, item, ','))
+                frames.push_back(std::atoi(item.c_str()));
+        } else if (arg == "--width" && has_value) {
+            width = std::atoi(argv[++a]);
+        } else if (arg == "--spp" && has_value) {
+            spp = std::atoi(argv[++a]);
+        } else if (arg == "--depth" && has_value) {
+            depth = std::atoi(argv[++a]);
+        } else if (arg == "--seed" && has_value) {
+            seed = static_cast<unsigned int>(std::atoi(argv[++a]));
+        } else if (arg == "--threads" && has_value) {
+            threads = std::max(0, std::atoi(argv[++a]));
+        } else if (arg == "--tile" && has_value) {
+            tile = std::max(1, std::atoi(argv[++a]));
+        } else if (arg == "--adaptive" && has_value) {
+            if (std::sscanf(argv[++a], "%d,%lf", &min_spp, &noise) != 2) {
+                std::cerr << "Error: --adaptive expects <min spp>,<noise>" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--progressive" && has_value) {
+            progressive = true;
+            if (std::sscanf(argv[++a], "%lf,%lf", &budget_ms, &target_noise) != 2) {
+                std::cerr << "Error: --progressive expects <milliseconds>,<noise>" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--sampler" && has_value) {
+            sampler_name = argv[++a];
+            if (!parse_sampler(sampler_name, sampling)) {
+                std::cerr << "Error: Unknown sampler " << sampler_name << std::endl;
+                return 1;
+            }
+        } else if (arg == "--no-light-sampling") {
+            light_sampling = false;
+        } else if (arg == "--cull-back-faces") {
+            cull_back_faces = true;
+        } else if (arg == "--denoise") {
+            denoise = true;
+        } else if (arg == "--temporal") {
+            temporal = true;
+        } else if (arg == "--aovs") {
+            aovs = true;
+        } else if (arg == "--scaling" && has_value) {
+            scaling_threads = std::max(1, std::atoi(argv[++a]));
+        } else if (arg == "--repeat" && has_value) {
+            repeat = std::max(1, std::atoi(argv[++a]));
+        } else if (arg == "--json" && has_value) {
+            json_path = argv[++a];
+        } else if (arg == "--images" && has_value) {
+            images_dir = argv[++a];
+        } else if (arg == "--compare" && has_value) {
+            compare_path = argv[++a];
+        } else if (arg == "--threshold" && has_value) {
+            threshold = std::atof(argv[++a]);
+        } else {
+            std::cerr << "Usage: " << argv[0] << " [--scene projeto_final|atividade05|stress|lights|all]"
+                      << " [--stress spheres,stars,triangles] [--frames 0,30,...]"
+                      << " [--width W] [--spp N] [--depth D] [--seed S] [--threads N] [--tile T] [--adaptive min,noise]"
+                      << " [--progressive ms,noise] [--sampler independent|sobol|halton|blue_noise] [--no-light-sampling] [--cull-back-faces] [--denoise] [--temporal] [--aovs] [--scaling N]"
+                      << " [--repeat R] [--json file]"
+                      << " [--images dir] [--compare baseline.json] [--threshold 0.05]" << std::endl;
+            return 1;
+        }
+    }
+
+    std::vector<scene> scenes;
+    auto build = [&](std::function<scene()> make) {
+        auto build_start = steady_clock::now();
+        scenes.push_back(make());
+        std::printf("Scene %s built in %.1f ms, %zu objects, RSS %ld KB\n", scenes.back().name.c_str(),
+                    duration<double, std::milli>(steady_clock::now() - build_start).count(),
+                    scenes.back().world.objects.size(), peak_rss_kb());
+    };
+    if (scene_name == "projeto_final" || scene_name == "all")
+        build([] { return projeto_final_scene(RESOURCE_DIR); });
+    if (scene_name == "atividade05" || scene_name == "all")
+        build([] { return atividade05_scene(RESOURCE_DIR); });
+    if (scene_name == "stress")
+        build([&] { return stress_scene(stress_spheres, stress_stars, stress_triangles, seed, RESOURCE_DIR); });
+    if (scene_name == "lights")
+        build([] { return lights_scene(); });
+    if (scenes.empty()) {
+        std::cerr << "Error: Unknown scene " << scene_name << std::endl;
+        return 1;
+    }
+
+    std::ostringstream config;
+    config << "{\"scene\":\"" << scene_name << "\",\"width\":" << width << ",\"spp\":" << spp << ",\"depth\":" << depth << ",\"seed\":" << seed
+           << ",\"min_spp\":" << min_spp << ",\"noise\":" << noise
+           << ",\"progressive\":" << (progressive ? "true" : "false") << ",\"budget_ms\":" << budget_ms
+           << ",\"target_noise\":" << target_noise << ",\"sampler\":\"" << sampler_name << "\""
+           << ",\"light_sampling\":" << (light_sampling ? "true" : "false")
+           << ",\"cull_back_faces\":" << (cull_back_faces ? "true" : "false")
+           << ",\"denoise\":" << (denoise ? "true" : "false")
+           << ",\"temporal\":" << (temporal ? "true" : "false")
+           << ",\"aovs\":" << (aovs ? "true" : "false")
+           << ",\"threads\":" << threads << ",\"tile\":" << tile << ",\"repeat\":" << repeat
+           << ",\"hardware_threads\":" << std::thread::hardware_concurrency() << "}";
+
+    std::vector<bench_result> results;
+    std::vector<scaling_result> scaling;
+    auto start = steady_clock::now();
+
+    if (scaling_threads > 0) {
+        // A single fixed image: the first selected frame of the first camera
+        scene& s = scenes[0];
+        int frame = std::min(std::max(frames[0], 0), s.frame_count - 1);
+        s.set_frame(frame);
+        camera& cam = s.cameras[0];
+        cam.image_width = width;
+        cam.samples_per_pixel = spp;
+        cam.max_depth = depth;
+        cam.tile_size = tile;
+        cam.seed = seed + frame;
+        cam.min_samples_per_pixel = min_spp;
+        cam.noise_threshold = noise;
+        cam.sampling = sampling;
+        if (!light_sampling) cam.lights = nullptr;
+        cam.cull_back_faces = cam.cull_back_faces || cull_back_faces;
+        cam.denoise = denoise;
+        cam.save_aovs = aovs;
+
+        std::printf("Scaling of %s/camera0/frame%d, %d hardware threads\n", s.name.c_str(), frame,
+                    static_cast<int>(std::thread::hardware_concurrency()));
+        scaling = measure_scaling(cam, s.world, scaling_threads, repeat);
+        if (scaling.empty())
+            return 1;
+
+        double total_ms = duration<double, std::milli>(steady_clock::now() - start).count();
+        if (!json_path.empty())
+            write_json(json_path, config.str(), results, scaling, total_ms);
+        return 0;
+    }
+
+    std::printf("%-32s %12s %12s %8s %18s %10s %10s\n", "Image", "ms", "Mrays/s", "spp", "checksum", "PSNR", "RSS KB");
+
+    for (scene& s : scenes) {
+        for (int frame : frames) {
+            if (frame < 0 || frame >= s.frame_count) {
+                std::cerr << "Skipping frame " << frame << ", " << s.name << " has " << s.frame_count << " frames" << std::endl;
+                continue;
+            }
+            s.set_frame(frame);
+
+            for (size_t c = 0; c < s.cameras.size(); c++) {
+                camera& cam = s.cameras[c];
+                cam.image_width = width;
+                cam.samples_per_pixel = spp;
+                cam.max_depth = depth;
+                cam.threads = threads;
+                cam.tile_size = tile;
+                cam.seed = seed + frame;
+                cam.min_samples_per_pixel = min_spp;
+                cam.noise_threshold = noise;
+                cam.sampling = sampling;
+                if (!light_sampling) cam.lights = nullptr;
+                cam.cull_back_faces = cam.cull_back_faces || cull_back_faces;
+                cam.denoise = denoise;
+                cam.temporal = temporal;
+                cam.save_aovs = aovs;
+                cam.time_budget_ms = budget_ms;
+                cam.target_noise = target_noise;
+
+                bench_result r;
+                r.name = s.name + "/camera" + std::to_string(c) + "/frame" + std::to_string(frame);
+                r.wall_ms = 1e30;
+
+                // A temporal render builds on the previous one, so every repeat starts from the same state
+                camera before_repeats = temporal && repeat > 1 ? cam : camera();
+                for (int k = 0; k < repeat; k++) {
+                    if (temporal && k > 0) cam = before_repeats;
+                    render_stats::collect();
+                    auto frame_start = steady_clock::now();
+                    if (progressive)
+                        cam.render_progressive(s.world);
+                    else
+                        cam.render(s.world);
+                    double ms = duration<double, std::milli>(steady_clock::now() - frame_start).count();
+                    render_counters stats = render_stats::collect();
+                    if (ms < r.wall_ms) {
+                        r.wall_ms = ms;
+                        r.rays = stats.total_rays();
+                        r.mean_spp = static_cast<double>(stats.primary_rays) / cam.frame().get_width() / cam.frame().get_height();
+                    }
+                }
+                std::clog << "\r" << std::flush;
+
+                r.rays_per_second = r.rays / (r.wall_ms / 1000);
+                r.checksum = image_checksum(cam.frame());
+                r.peak_rss_kb = peak_rss_kb();
+
+                if (!images_dir.empty()) {
+                    std::string image_path = images_dir + "/" + s.name + "_camera" + std::to_string(c)
+                                           + "_frame" + std::to_string(frame) + ".ppm";
+                    framebuffer stored;
+                    if (read_p6(image_path, stored) && stored.get_width() == cam.frame().get_width()
+                        && stored.get_height() == cam.frame().get_height())
+                        r.psnr = psnr(stored, cam.frame());
+                    else
+                        saveToP6(image_path, cam.frame());
+                }
+
+                std::printf("%-32s %12.1f %12.3f %8.2f %18s %10s %10ld\n", r.name.c_str(), r.wall_ms, r.rays_per_second / 1e6,
+                            r.mean_spp, r.checksum.c_str(), r.psnr < 0 ? "-" : (std::isinf(r.psnr) ? "inf" : std::to_string(r.psnr).c_str()),
+                            r.peak_rss_kb);
+                results.push_back(r);
+            }
+        }
+    }
+
+    double total_ms = duration<double, std::milli>(steady_clock::now() - start).count();
+    std::printf("Total: %.1f ms, peak RSS %ld KB\n", total_ms, peak_rss_kb());
+
+    if (!json_path.empty())
+        write_json(json_path, config.str(), results, scaling, total_ms);
+
+    if (!compare_path.empty() && compare(compare_path, results, threshold) > 0)
+        return 1;
+
+    return 0;
+}
@@ -0,0 +1,246 @@
+/**
+ * @file atrous_denoiser.h
+ * @brief Contains the atrous_denoiser class, an edge avoiding wavelet filter for noisy renders
+ */
+#ifndef ATROUS_DENOISER_H
+#define ATROUS_DENOISER_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "hdr_framebuffer.h"
+#include "feature_buffer.h"
+
+/**
+ * @class atrous_denoiser
+ * @brief Smooths the noise of a rendered image without blurring across the edges of the scene
+ * (Dammertz et al., "Edge-Avoiding À-Trous Wavelet Transform for fast Global Illumination
+ * Filtering").
+ *
+ * Each iteration blurs the image with a 5x5 B3 spline kernel whose taps are spread 2^iteration
+ * pixels apart, so a few iterations cover a wide footprint at 25 taps per pixel each. A tap is
+ * weighed down when its pixel differs from the center in color, albedo, normal or depth, so
+ * light does not leak between objects. Depth differences are measured against the local depth
+ * slope, which keeps surfaces seen at grazing angles smooth. The color tolerance halves at every
+ * iteration, as the noise left is smaller.
+ *
+ * The radiance is divided by the albedo before filtering and multiplied back after, so only the
+ * lighting is smoothed and the colors of the surfaces stay sharp. Colors are compared on the
+ * square root scale tone_map displays.
+ *
+ * Every channel is a separate plane of floats and the taps are applied a row at a time, so the
+ * inner loops have no branches and the compiler can vectorize them. Rows are split between threads.
+ *
+ * @param iterations The number of filter passes, each one doubling the footprint.
+ * @param sigma_color The color difference, on the displayed 0 to 1 scale, at which taps lose most of their weight.
+ * @param sigma_albedo The albedo difference at which taps lose most of their weight.
+ * @param sigma_normal The normal difference at which taps lose most of their weight.
+ * @param sigma_depth The depth difference, in local depth slopes, at which taps lose most of their weight.
+ */
+class atrous_denoiser {
+  public:
+    int   iterations   = 3;
+    float sigma_color  = 0.3f;
+    float sigma_albedo = 0.1f;
+    float sigma_normal = 0.2f;
+    float sigma_depth  = 1.0f;
+
+    /**
+     * Filters the mean radiance of every pixel.
+     *
+     * @param radiance the noisy image
+     * @param features the averaged first hits of the same image
+     * @param out receives the filtered image, one sample per pixel, resized if needed
+     * @param threads the number of threads to filter with
+     */
+    void denoise(const hdr_framebuffer& radiance, const feature_buffer& features, hdr_framebuffer& out,
+                 int threads) const {
+        const int width = radiance.get_width();
+        const int height = radiance.get_height();
+        const size_t pixels = static_cast<size_t>(width) * height;
+
+        const float* albedo[3] = {
+            features.plane(feature_buffer::albedo_r),
+            features.plane(feature_buffer::albedo_g),
+            features.plane(feature_buffer::albedo_b),
+        };
+
+        // The lighting, radiance divided by albedo, as planes
+        std::vector<float> rgba = radiance.resolve();
+        std::vector<float> light[3], filtered[3];
+        for (int c = 0; c < 3; c++) {
+            light[c].resize(pixels);
+            filtered[c].resize(pixels);
+            for (size_t k = 0; k < pixels; k++)
+                light[c][k] = rgba[k * 4 + c] / std::max(albedo[c][k], min_albedo);
+        }
+
+        std::vector<float> slope = depth_slope(features.plane(feature_buffer::depth), width, height);
+
+        std::vector<float> display[3];
+        for (int c = 0; c < 3; c++) display[c].resize(pixels);
+
+        for (int iteration = 0; iteration < iterations; iteration++) {
+            for (int c = 0; c < 3; c++)
+                for (size_t k = 0; k < pixels; k++)
+                    display[c][k] = std::sqrt(std::max(light[c][k] * albedo[c][k], 0.0f));
+
+            pass current;
+            current.width = width;
+            current.height = height;
+            current.step = 1 << iteration;
+            current.inv_color = 1.0f / (sigma_color * sigma_color * std::ldexp(1.0f, -iteration));
+            current.inv_albedo = 1.0f / (sigma_albedo * sigma_albedo);
+            current.inv_normal = 1.0f / (sigma_normal * sigma_normal);
+            current.inv_depth = 1.0f / sigma_depth;
+            for (int c = 0; c < 3; c++) {
+                current.light[c] = light[c].data();
+                current.display[c] = display[c].data();
+                current.albedo[c] = albedo[c];
+                current.normal[c] = features.plane(static_cast<feature_buffer::channel>(feature_buffer::normal_x + c));
+                current.out[c] = filtered[c].data();
+            }
+            current.depth = features.plane(feature_buffer::depth);
+            current.slope = slope.data();
+
+            run_rows(current, threads);
+            for (int c = 0; c < 3; c++) std::swap(light[c], filtered[c]);
+        }
+
+        if (out.get_width() != width || out.get_height() != height)
+            out.resize(width, height);
+        else
+            out.clear();
+        for (int j = 0; j < height; j++) {
+            for (int i = 0; i < width; i++) {
+                size_t k = static_cast<size_t>(j) * width + i;
+                out.add_sample(i, j, color(light[0][k] * std::max(albedo[0][k], min_albedo),
+                                           light[1][k] * std::max(albedo[1][k], min_albedo),
+                                           light[2][k] * std::max(albedo[2][k], min_albedo)));
+            }
+        }
+    }
+
+  private:
+    static constexpr float min_albedo = 0.01f; // Keeps black surfaces from dividing by zero
+
+    /**
+     * @brief The planes and tolerances of one filter iteration
+     */
+    struct pass {
+        int width, height, step;
+        float inv_color, inv_albedo, inv_normal, inv_depth;
+        const float* light[3];
+        const float* display[3];
+        const float* albedo[3];
+        const float* normal[3];
+        const float* depth;
+        const float* slope;
+        float* out[3];
+    };
+
+    /**
+     * @return e^x for x <= 0, within about 1e-4, built from a polynomial for the fraction of the
+     * power of 2 and the float exponent bits for its integer part, so it vectorizes
+     */
+    static float exp_negative(float x) {
+        float t = std::max(x, -80.0f) * 1.44269504f; // In powers of 2
+        int32_t n = static_cast<int32_t>(t);           // Toward zero, so f is in (-1, 0]
+        float f = t - static_cast<float>(n);
+        float p = 1.0f + f * (0.6931472f + f * (0.2402265f + f * (0.0555041f + f * 0.0096181f)));
+        int32_t bits = (n + 127) << 23;
+        float scale;
+        std::memcpy(&scale, &bits, sizeof scale);
+        return p * scale;
+    }
+
+    /**
+     * @return for every pixel, the largest depth change to its neighbors, at least a small
+     * fraction of its depth so flat regions still allow some difference
+     */
+    static std::vector<float> depth_slope(const float* depth, int width, int height) {
+        std::vector<float> slope(static_cast<size_t>(width) * height);
+        for (int j = 0; j < height; j++) {
+            for (int i = 0; i < width; i++) {
+                size_t k = static_cast<size_t>(j) * width + i;
+                float dx = 0.5f * std::fabs(depth[j * width + std::min(i + 1, width - 1)] - depth[j * width + std::max(i - 1, 0)]);
+                float dy = 0.5f * std::fabs(depth[std::min(j + 1, height - 1) * width + i] - depth[std::max(j - 1, 0) * width + i]);
+                slope[k] = std::max(std::max(dx, dy), 1e-3f * depth[k]);
+            }
+        }
+        return slope;
+    }
+
+    static void run_rows(const pass& p, int threads) {
+        threads = std::max(1, std::min(threads, p.height));
+        std::vector<std::thread> pool;
+        auto work = [&p, threads](int t) {
+            std::vector<float> sums[3], weights;
+            for (auto& sum : sums) sum.resize(p.width);
+            weights.resize(p.width);
+            for (int j = t; j < p.height; j += threads)
+                filter_row(p, j, sums, weights);
+        };
+        for (int t = 1; t < threads; t++)
+            pool.emplace_back(work, t);
+        work(0);
+        for (auto& thread : pool) thread.join();
+    }
+
+    /**
+     * Filters row j, adding the 25 taps one at a time over the whole row.
+     */
+    static void filter_row(const pass& p, int j, std::vector<float> (&sums)[3], std::vector<float>& weights) {
+        static const float kernel[5] = {1.0f / 16, 1.0f / 4, 3.0f / 8, 1.0f / 4, 1.0f / 16};
+
+        for (int c = 0; c < 3; c++) std::fill(sums[c].begin(), sums[c].end(), 0.0f);
+        std::fill(weights.begin(), weights.end(), 0.0f);
+
+        const size_t row = static_cast<size_t>(j) * p.width;
+        for (int ty = -2; ty <= 2; ty++) {
+            int qj = j + ty * p.step;
+            if (qj < 0 || qj >= p.height) continue;
+
+            for (int tx = -2; tx <= 2; tx++) {
+                const int dx = tx * p.step;
+                const float h = kernel[ty + 2] * kernel[tx + 2];
+                const float distance = static_cast<float>(p.step) * std::sqrt(static_cast<float>(tx * tx + ty * ty));
+                const int first = std::max(0, -dx), last = std::min(p.width, p.width - dx);
+                // Offsets of the tap from the center pixel, so both index the same loop counter
+                const ptrdiff_t shift = static_cast<ptrdiff_t>(qj - j) * p.width + dx;
+
+                for (int i = first; i < last; i++) {
+                    size_t k = row + i;
+                    size_t q = k + shift;
+
+                    float dc = 0, da = 0, dn = 0;
+                    for (int c = 0; c < 3; c++) {
+                        float d = p.display[c][k] - p.display[c][q];
+                        dc += d * d;
+                        d = p.albedo[c][k] - p.albedo[c][q];
+                        da += d * d;
+                        d = p.normal[c][k] - p.normal[c][q];
+                        dn += d * d;
+                    }
+                    float dz = std::fabs(p.depth[k] - p.depth[q]) / (p.slope[k] * distance + 1e-6f);
+
+                    float w = h * exp_negative(-(dc * p.inv_color + da * p.inv_albedo + dn * p.inv_normal + dz * p.inv_depth));
+                    for (int c = 0; c < 3; c++) sums[c][i] += w * p.light[c][q];
+                    weights[i] += w;
+                }
+            }
+        }
+
+        // The center tap always has a weight, so no pixel is left without one
+        for (int c = 0; c < 3; c++)
+            for (int i = 0; i < p.width; i++)
+                p.out[c][row + i] = sums[c][i] / weights[i];
+    }
+};
+
+#endif
@@ -0,0 +1,196 @@
+/**
+ * @file band_writer.h
+ * @brief Contains writers that save an image band by band, as horizontal strips finish rendering
+ */
+#ifndef BAND_WRITER_H
+#define BAND_WRITER_H
+
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "framebuffer.h"
+#include "png_writer.h"
+
+/**
+ * @class band_writer
+ * @brief Abstract class for image files written top to bottom in horizontal bands.
+ *
+ * Only the band being written has to be in memory, so the memory used does not depend on the
+ * height of the image.
+ */
+class band_writer {
+  public:
+    virtual ~band_writer() = default;
+
+    /**
+     * Starts a new image of the given size.
+     *
+     * @return false if the file could not be opened
+     */
+    virtual bool begin(int width, int height) = 0;
+
+    /**
+     * Appends the next rows of the image. Bands must be given top to bottom.
+     */
+    virtual void write_band(const framebuffer& band) = 0;
+
+    /**
+     * Completes the file after the last band.
+     */
+    virtual void finish() = 0;
+};
+
+/**
+ * @class ppm_band_writer
+ * @brief Writes bands to a binary P6 PPM file.
+ *
+ * @param filename The name of the PPM file.
+ */
+class ppm_band_writer : public band_writer {
+  public:
+    ppm_band_writer(std::string _filename) : filename(_filename) {}
+    ~ppm_band_writer() { finish(); }
+
+    bool begin(int width, int height) override {
+        out = std::fopen(filename.c_str(), "wb");
+        if (out == nullptr) {
+            std::cerr << "Error: Could not open " << filename << std::endl;
+            return false;
+        }
+        std::fprintf(out, "P6\n%d %d\n255\n", width, height);
+        return true;
+    }
+
+    void write_band(const framebuffer& band) override {
+        if (out != nullptr)
+            std::fwrite(band.data(), 1, band.size(), out);
+    }
+
+    void finish() override {
+        if (out != nullptr)
+            std::fclose(out);
+        out = nullptr;
+    }
+
+  private:
+    std::string filename;
+    std::FILE* out = nullptr;
+};
+
+/**
+ * @class png_band_writer
+ * @brief Writes bands to a PNG file, one IDAT chunk per band.
+ *
+ * Each band is filtered (using the last row of the previous band) and deflated with
+ * png_detail::deflate_stripe, with the last 32K of filtered data as dictionary, and ends with a
+ * sync flush. The chunks together form a single zlib stream, closed in finish by an empty final
+ * block and the Adler-32 of all filtered rows.
+ *
+ * @param filename The name of the PNG file.
+ * @param quality The compression level, as in stbi_write_png_compression_level.
+ */
+class png_band_writer : public band_writer {
+  public:
+    png_band_writer(std::string _filename, int _quality = 8) : filename(_filename), quality(_quality) {}
+    ~png_band_writer() { finish(); }
+
+    bool begin(int _width, int height) override {
+        using namespace png_detail;
+
+        width = _width;
+        out = std::fopen(filename.c_str(), "wb");
+        if (out == nullptr) {
+            std::cerr << "Error: Could not open " << filename << std::endl;
+            return false;
+        }
+
+        std::vector<unsigned char> bytes = {137, 80, 78, 71, 13, 10, 26, 10};
+        std::vector<unsigned char> header;
+        put_u32(header, static_cast<uint32_t>(width));
+        put_u32(header, static_cast<uint32_t>(height));
+        header.insert(header.end(), {8, 2, 0, 0, 0}); // 8 bit RGB, no interlacing
+        put_chunk(bytes, "IHDR", header);
+        std::fwrite(bytes.data(), 1, bytes.size(), out);
+
+        previous_row.clear();
+        history.clear();
+        adler = 1;
+        first_chunk = true;
+        return true;
+    }
+
+    void write_band(const framebuffer& band) override {
+        using namespace png_detail;
+        if (out == nullptr || band.get_height() == 0) return;
+
+        const size_t row_length = static_cast<size_t>(width) * 3 + 1;
+        const size_t dictionary = history.size();
+
+        // Filter the band behind the dictionary, with the previous band's last row above its first row
+        std::vector<unsigned char> pixels;
+        if (!previous_row.empty())
+            pixels.insert(pixels.end(), previous_row.begin(), previous_row.end());
+        pixels.insert(pixels.end(), band.data(), band.data() + band.size());
+        const int skip = previous_row.empty() ? 0 : 1;
+
+        std::vector<unsigned char> filtered(row_length * (band.get_height() + skip));
+        filter_rows(pixels.data(), width, skip, band.get_height() + skip, filtered.data());
+
+        std::vector<unsigned char> data(history);
+        data.insert(data.end(), filtered.begin() + row_length * skip, filtered.end());
+
+        adler = adler32(data.data() + dictionary, data.size() - dictionary, adler);
+
+        deflate_stripe encoder(quality);
+        std::vector<unsigned char> compressed = encoder.compress(data.data(), dictionary, data.size(), false);
+        write_idat(compressed);
+
+        // Keep what the next band needs: its row above and the deflate window
+        previous_row.assign(band.data() + band.size() - static_cast<size_t>(width) * 3, band.data() + band.size());
+        size_t keep = std::min<size_t>(data.size(), 32768);
+        history.assign(data.end() - keep, data.end());
+    }
+
+    void finish() override {
+        using namespace png_detail;
+        if (out == nullptr) return;
+
+        std::vector<unsigned char> tail = {0x03, 0x00}; // Empty final fixed huffman block
+        put_u32(tail, adler);
+        write_idat(tail);
+
+        std::vector<unsigned char> bytes;
+        put_chunk(bytes, "IEND", std::vector<unsigned char>());
+        std::fwrite(bytes.data(), 1, bytes.size(), out);
+
+        std::fclose(out);
+        out = nullptr;
+    }
+
+  private:
+    std::string filename;
+    int quality;
+    std::FILE* out = nullptr;
+    int width = 0;
+    std::vector<unsigned char> previous_row;
+    std::vector<unsigned char> history;
+    uint32_t adler = 1;
+    bool first_chunk = true;
+
+    void write_idat(const std::vector<unsigned char>& body) {
+        std::vector<unsigned char> data;
+        if (first_chunk) {
+            data = {0x78, 0x5e}; // zlib header: 32K window, default compression
+            first_chunk = false;
+        }
+        data.insert(data.end(), body.begin(), body.end());
+
+        std::vector<unsigned char> bytes;
+        png_detail::put_chunk(bytes, "IDAT", data);
+        std::fwrite(bytes.data(), 1, bytes.size(), out);
+    }
+};
+
+#endif
@@ -8,10 +8,28 @@
 #include "util/rtweekend.h"
 
 #include "color.h"
+#include "framebuffer.h"
+#include "hdr_framebuffer.h"
+#include "feature_buffer.h"
+#include "atrous_denoiser.h"
+#include "temporal_accumulator.h"
+#include "band_writer.h"
+#include "cost_buffer.h"
+#include "render_profile.h"
+#include "util/render_stats.h"
+#include "util/sampler.h"
+#include "util/trace.h"
 #include "geometry/hittable.h"
 #include "geometry/material.h"
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <functional>
 #include <iostream>
+#include <thread>
+#include <vector>
 
 /**
  * @class camera
@@ -19,12 +37,34 @@
  *
  * @param aspect_ratio The ratio of the image's width to its height.
  * @param image_width The width of the image that the camera will render, in pixels.
- * @param samples_per_pixel The number of samples to take per pixel for anti-aliasing.
+ * @param samples_per_pixel The number of samples to take per pixel for anti-aliasing, the maximum in adaptive sampling.
  * @param max_depth The maximum recursion depth for ray bouncing.
  * @param vfov The camera's vertical field of view, in degrees.
  * @param lookfrom The location in the scene from which the camera is viewing.
  * @param lookat The Point the camera is looking at.
  * @param vup Camera-relative "up" direction.
+ * @param save_ppm Whether render also exports an ASCII P3 PPM file.
+ * @param save_pfm Whether render also exports the linear radiance as a PFM file.
+ * @param save_exr Whether render also exports the linear radiance as an OpenEXR file.
+ * @param exposure The linear scale applied to the radiance before tone mapping.
+ * @param heatmap Whether render also records the time, intersection tests or samples spent on each pixel.
+ * @param threads The number of rendering threads, 0 for one per hardware thread.
+ * @param tile_size The side of the square tiles the threads take from the image, in pixels.
+ * @param seed The seed of the random numbers. The image depends only on it, not on threads or tile_size.
+ * @param min_samples_per_pixel The samples every pixel takes before adaptive sampling may stop it, 0 to turn it off.
+ * @param noise_threshold The standard error, on the gamma corrected 0 to 1 scale, at which adaptive sampling stops a pixel.
+ * @param sampling The sequence the pixel samples and bounces draw their random numbers from.
+ * @param pass_samples The samples per pixel added by each pass of render_progressive.
+ * @param time_budget_ms The time render_progressive may take, in milliseconds, 0 for no limit.
+ * @param target_noise The image noise, on the scale of noise_threshold, at which render_progressive stops, 0 for none.
+ * @param lights The emissive objects that diffuse bounces send shadow rays to, null for none.
+ * @param sky_brightness The scale of the sky gradient, 0 for a scene lit only by its lights.
+ * @param cull_back_faces Whether rays outside every object skip back faces, which is exact for closed meshes and makes open meshes one sided.
+ * @param denoise Whether render and render_progressive filter the finished image with denoiser.
+ * @param denoiser The settings of the denoiser.
+ * @param temporal Whether render adds the reprojected samples of the previous frame to every frame, for animations.
+ * @param history The settings of the temporal accumulation, and the samples it carries between frames.
+ * @param save_aovs Whether render also exports what the camera rays hit first: depth, normal, albedo, position, object and material ids.
  */
 class camera {
   public:
@@ -38,29 +78,225 @@ class camera {
     point3 lookat   = point3(0,0,0);
     vec3   vup      = vec3(0,1,0);
 
+    bool   save_ppm          = false; // Also export an ASCII P3 PPM next to the PNG
+    bool   save_pfm          = false; // Also export the linear radiance as PFM
+    bool   save_exr          = false; // Also export the linear radiance as OpenEXR
+    double exposure          = 1.0;   // Linear scale applied before tone mapping
+    heatmap_mode heatmap     = heatmap_off; // Per pixel cost recorded by render
+
+    int      threads   = 0;  // Rendering threads, 0 for one per hardware thread
+    int      tile_size = 32; // Side of the tiles handed to the threads
+    uint64_t seed      = 0;  // Seed of the random numbers of every pixel
+
+    int    min_samples_per_pixel = 0;    // Adaptive sampling when above 0 and below samples_per_pixel
+    double noise_threshold       = 0.01; // Displayed noise at which adaptive sampling stops a pixel
+    sampler_kind sampling        = sampler_independent; // Sequence of the sample values
+
+    int    pass_samples   = 4; // Samples per pixel of each progressive pass
+    double time_budget_ms = 0; // Deadline of render_progressive, 0 for none
+    double target_noise   = 0; // Noise at which render_progressive stops, 0 for none
+
+    shared_ptr<hittable> lights;  // Sampled by shadow rays at diffuse bounces, null for none
+    double sky_brightness = 1.0; // Scale of the sky gradient
+    bool   cull_back_faces = false; // Skip back faces while the path is outside every object
+
+    bool denoise = false;     // Filter the image once it is rendered
+    atrous_denoiser denoiser; // Filter guided by the first hits of the camera rays
+
+    bool temporal = false;        // Reuse the samples of the previous frame
+    temporal_accumulator history; // Samples carried between frames, and how
+
+    bool save_aovs = false; // Also export the first hits of the camera rays
+
+    /**
+     * Renders the scene into the camera's framebuffer and saves it as a PNG file.
+     *
+     * With save_aovs, the first hits of the camera rays are saved from the same pass: as layers of
+     * the EXR file when save_exr is on, as PFM files when save_pfm is on, and otherwise as PNG
+     * previews (see saveAovsToPng).
+     *
+     * @param world the scene to be rendered
+     * @param file_name the output file name, without extension
+     */
     void render(const hittable& world, const std::string file_name) {
+        render(world);
+
+        saveToPng(file_name + ".png", image);
+        if (save_ppm)
+            saveToPPM(file_name + ".ppm", image);
+        if (save_pfm)
+            saveToPfm(file_name + ".pfm", frame_output());
+        if (save_exr)
+            saveToExr(file_name + ".exr", frame_output(), exr_rle_compression, save_aovs ? &first_hits : nullptr);
+        if (save_aovs && save_pfm)
+            saveAovsToPfm(file_name, first_hits);
+        if (save_aovs && !save_pfm && !save_exr)
+            saveAovsToPng(file_name, first_hits);
+        if (heatmap != heatmap_off) {
+            framebuffer heat;
+            cost.to_image(heat);
+            saveToPng(file_name + "_heatmap.png", heat);
+        }
+    }
+
+    /**
+     * Renders the scene into the camera's framebuffers without saving them.
+     *
+     * Samples are accumulated in linear floating point, and the 8 bit image is produced by a
+     * single tone mapping pass at the end. With denoise, the first hits of the camera rays are
+     * recorded along the samples and guide the filter applied before tone mapping. With temporal,
+     * the samples of the previous frame are reprojected into this one first (see
+     * temporal_accumulator), and every frame draws new sample indices so the frames do not repeat
+     * each other's noise. With save_aovs, the first hits are kept too (see frame_features).
+     *
+     * @param world the scene to be rendered
+     */
+    void render(const hittable& world) {
+        initialize();
+        prepare_buffers();
+
+        profile.reset(thread_count());
+        render_band(world, 0, image_height, radiance, heatmap != heatmap_off ? &cost : nullptr, 0, -1,
+                    records_features() ? &features : nullptr);
+        finish_frame(temporal);
+    }
+
+    /**
+     * Renders the scene in passes of pass_samples samples over the whole image, so a usable image
+     * exists after the first pass and improves with each one.
+     *
+     * Rendering stops when samples_per_pixel is reached, when the next pass would end after
+     * time_budget_ms, or when the estimated noise falls below target_noise. With denoise, the passes
+     * are shown unfiltered and only the final image is filtered. temporal is not used, save_aovs is. Every sample is seeded
+     * by its pixel and index and added in the same order as in render, so a progressive render
+     * that reaches samples_per_pixel gives exactly the same image. Adaptive sampling is not used.
+     *
+     * The noise is estimated every second pass from a buffer that holds only the even passes,
+     * whose difference from the full accumulation is about the standard error of each pixel.
+     *
+     * @param world the scene to be rendered
+     * @param after_pass called after every pass, with the pass index and the samples per pixel
+     * rendered so far, once frame() holds the image of the pass
+     *
+     * @return the samples per pixel rendered
+     */
+    int render_progressive(const hittable& world, std::function<void(int, int)> after_pass = nullptr) {
+        using clock = std::chrono::steady_clock;
+        const auto start = clock::now();
+
         initialize();
+        prepare_buffers();
+        profile.reset(thread_count());
+        const int step = std::max(1, pass_samples);
 
-        std::ostringstream output_stream;
+        hdr_framebuffer even_passes, before_pass;
+        if (target_noise > 0) even_passes.resize(image_width, image_height);
 
-        output_stream << "P3\n" << image_width << ' ' << image_height << "\n255\n";
+        int samples = 0;
+        for (int pass = 0; samples < samples_per_pixel; pass++) {
+            TRACE_SCOPE_INDEX("pass", pass);
+            auto pass_start = clock::now();
+            int pass_end = std::min(samples + step, samples_per_pixel);
 
-        for (int j = 0; j < image_height; ++j) {
-            std::clog << "\rScanlines remaining: " << (image_height - j) << ' ' << std::flush;
-            for (int i = 0; i < image_width; ++i) {
-                color pixel_color(0,0,0);
-                for (int sample = 0; sample < samples_per_pixel; ++sample) {
-                    ray r = get_ray(i, j);
-                    pixel_color += ray_color(r, max_depth, world);
-                }
-                write_color(output_stream, pixel_color, samples_per_pixel);
-            }
+            bool even = target_noise > 0 && pass % 2 == 0;
+            if (even) before_pass = radiance;
+            render_band(world, 0, image_height, radiance, heatmap != heatmap_off ? &cost : nullptr, samples, pass_end,
+                        denoise || save_aovs ? &features : nullptr, false);
+            if (even) even_passes.add_difference(radiance, before_pass);
+            samples = pass_end;
+
+            radiance.tone_map(image, exposure);
+            if (after_pass) after_pass(pass, samples);
+
+            auto now = clock::now();
+            last_noise = target_noise > 0 && pass % 2 == 1 ? estimate_noise(even_passes) : -1;
+            if (last_noise >= 0 && last_noise < target_noise)
+                break;
+
+            double elapsed_ms = std::chrono::duration<double, std::milli>(now - start).count();
+            double pass_ms = std::chrono::duration<double, std::milli>(now - pass_start).count();
+            if (time_budget_ms > 0 && elapsed_ms + pass_ms > time_budget_ms)
+                break;
+        }
+
+        if (denoise || save_aovs) finish_frame(false);
+        return samples;
+    }
+
+    /**
+     * Renders the scene in horizontal bands, handing each band to a writer as soon as it is done.
+     *
+     * Only one band is kept in memory, so the memory used is bounded by band_height times the
+     * image width, whatever the image height. The camera's own framebuffers are not used.
+     *
+     * @param world the scene to be rendered
+     * @param out the writer that receives the bands, top to bottom
+     * @param band_height the number of rows rendered per band
+     *
+     * @return false if the writer could not be started
+     */
+    bool render_streaming(const hittable& world, band_writer& out, int band_height = 64) {
+        initialize();
+        if (band_height < 1) band_height = 1;
+
+        if (!out.begin(image_width, image_height))
+            return false;
+
+        profile.reset(thread_count());
+        hdr_framebuffer band_radiance;
+        framebuffer band_image;
+        for (int first = 0; first < image_height; first += band_height) {
+            int rows = std::min(band_height, image_height - first);
+            if (band_radiance.get_height() != rows)
+                band_radiance.resize(image_width, rows);
+            else
+                band_radiance.clear();
+
+            render_band(world, first, first + rows, band_radiance);
+            band_radiance.tone_map(band_image, exposure);
+            out.write_band(band_image);
         }
 
-        // saveToPPM(file_name + ".ppm", output_stream.str());
-        saveToPng(file_name + ".png", image_width, image_height, output_stream.str());
+        out.finish();
+        return true;
     }
 
+    /**
+     * @return the framebuffer holding the last rendered image
+     */
+    const framebuffer& frame() const { return image; }
+
+    /**
+     * @return the linear radiance accumulated by the last render
+     */
+    const hdr_framebuffer& frame_radiance() const { return radiance; }
+
+    /**
+     * @return the linear image the last render shows: the radiance, filtered when denoise is on
+     */
+    const hdr_framebuffer& frame_output() const { return denoise ? denoised : radiance; }
+
+    /**
+     * @return the averaged first hits of the camera rays of the last render, such as depth,
+     * normal and object id, or an empty buffer when neither denoise, temporal nor save_aovs is on
+     */
+    const feature_buffer& frame_features() const { return first_hits; }
+
+    /**
+     * @return the per pixel cost recorded by the last render, empty when heatmap is off
+     */
+    const cost_buffer& frame_cost() const { return cost; }
+
+    /**
+     * @return how the last render was spread over the threads
+     */
+    const render_profile& last_profile() const { return profile; }
+
+    /**
+     * @return the noise estimated by the last render_progressive, or -1 if it was not estimated
+     */
+    double last_noise_estimate() const { return last_noise; }
+
   private:
     int    image_height;   // Rendered image height
     point3 center;         // Camera center
@@ -68,6 +304,15 @@ class camera {
     vec3   pixel_delta_u;  // Offset to pixel to the right
     vec3   pixel_delta_v;  // Offset to pixel below
     vec3   u, v, w;        // Camera frame basis vectors
+    framebuffer image;     // Rendered image
+    hdr_framebuffer radiance; // Accumulated linear samples
+    feature_buffer features;  // First hits of the camera rays, when denoise, temporal or save_aovs is on
+    feature_buffer first_hits; // The features averaged, once the frame is rendered
+    hdr_framebuffer denoised; // Filtered radiance, when denoise is on
+    cost_buffer cost;      // Per pixel render cost, when heatmap is on
+    render_profile profile; // Thread and tile times of the last render
+    double last_noise = -1; // Noise estimated by the last progressive render
+    int    first_frame_sample = 0; // Index of the first sample of the frame, advanced by temporal frames
 
     void initialize() {
         image_height = static_cast<int>(image_width / aspect_ratio);
@@ -100,43 +345,386 @@ class camera {
         pixel00_loc = viewport_upper_left + 0.5 * (pixel_delta_u + pixel_delta_v);
     }
 
-     ray get_ray(int i, int j) const {
+    /**
+     * Sizes the framebuffers for the image and clears the radiance and the costs.
+     */
+    void prepare_buffers() {
+        if (image.get_width() != image_width || image.get_height() != image_height)
+            image.resize(image_width, image_height);
+        if (radiance.get_width() != image_width || radiance.get_height() != image_height)
+            radiance.resize(image_width, image_height);
+
+        radiance.clear();
+        if (records_features()) {
+            if (features.get_width() != image_width || features.get_height() != image_height)
+                features.resize(image_width, image_height);
+            else
+                features.clear();
+        }
+        if (heatmap != heatmap_off) {
+            if (cost.get_width() != image_width || cost.get_height() != image_height)
+                cost.resize(image_width, image_height);
+            else
+                cost.clear();
+        }
+    }
+
+    bool records_features() const { return denoise || temporal || save_aovs; }
+
+    /**
+     * @return the view of the camera, for reprojecting into it later
+     */
+    camera_view view() const {
+        camera_view current;
+        current.center = center;
+        current.pixel00 = pixel00_loc;
+        current.delta_u = pixel_delta_u;
+        current.delta_v = pixel_delta_v;
+        current.width = image_width;
+        current.height = image_height;
+        return current;
+    }
+
+    /**
+     * Averages the first hits when they are recorded, adds the history of the previous frames to
+     * the radiance when accumulate is set, filters the radiance when denoise is on and tone maps
+     * the result into the image. The time spent on the history and the filter is added to profile.
+     */
+    void finish_frame(bool accumulate) {
+        if (records_features()) {
+            first_hits = features;
+            first_hits.average();
+        }
+        if (accumulate) {
+            TRACE_SCOPE("temporal");
+            auto temporal_start = std::chrono::steady_clock::now();
+            history.accumulate(radiance, first_hits, view());
+            first_frame_sample += samples_per_pixel;
+            profile.temporal_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - temporal_start).count();
+        }
+        if (denoise) {
+            TRACE_SCOPE("denoise");
+            auto denoise_start = std::chrono::steady_clock::now();
+            denoiser.denoise(radiance, first_hits, denoised, thread_count());
+            profile.denoise_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - denoise_start).count();
+        }
+        TRACE_SCOPE("tone_map");
+        frame_output().tone_map(image, exposure);
+    }
+
+    /**
+     * @return the root mean square over the pixels of the standard error of their displayed
+     * luminance, estimated from the difference between the radiance and the even passes
+     */
+    double estimate_noise(const hdr_framebuffer& even_passes) const {
+        double squared_errors = 0;
+        for (int j = 0; j < image_height; j++) {
+            for (int i = 0; i < image_width; i++) {
+                double all = exposure * luminance(radiance.average(i, j));
+                double half = exposure * luminance(even_passes.average(i, j));
+                double error = (half - all) / (2 * std::sqrt(std::max(all, 1e-4)));
+                squared_errors += error * error;
+            }
+        }
+        return std::sqrt(squared_errors / (static_cast<double>(image_width) * image_height));
+    }
+
+    static double luminance(const color& c) { return 0.2126 * c.x() + 0.7152 * c.y() + 0.0722 * c.z(); }
+
+    int thread_count() const {
+        if (threads > 0) return threads;
+        return std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+    }
+
+    /**
+     * Renders the samples [first_sample, last_sample) of the rows [first, last) of the image into
+     * target, whose row 0 is image row first. A negative last_sample stands for samples_per_pixel.
+     * When costs is given, the cost of each pixel selected by heatmap is added to it, at its image
+     * coordinates, and when features is given, the first hit of every camera sample. Pixels sample
+     * adaptively when adaptive() is on, unless adaptive_pixels is false, as for progressive passes.
+     *
+     * The rows are cut into square tiles, which the threads take in order until none is left, so
+     * a thread that drew cheap tiles takes more of them. Every pixel seeds the random numbers from
+     * seed and its position, so the result does not depend on which thread rendered it. The
+     * times of the threads and tiles are added to profile.
+     */
+    void render_band(const hittable& world, int first, int last, hdr_framebuffer& target,
+                     cost_buffer* costs = nullptr, int first_sample = 0, int last_sample = -1,
+                     feature_buffer* features = nullptr, bool adaptive_pixels = true) {
+        using clock = std::chrono::steady_clock;
+        TRACE_SCOPE_INDEX("render_band", first);
+
+        const int tile = std::max(1, tile_size);
+        const int tiles_across = (image_width + tile - 1) / tile;
+        const int tile_count = tiles_across * ((last - first + tile - 1) / tile);
+        const int workers = std::max(1, std::min(profile.thread_count(), tile_count));
+        if (last_sample < 0) last_sample = samples_per_pixel;
+
+        std::atomic<int> next_tile(0);
+        std::vector<std::vector<tile_time>> tiles_done(workers);
+        std::vector<double> finish_ms(workers, 0.0);
+        const auto band_start = clock::now();
+
+        auto work = [&](int worker) {
+            const bool reports = worker == 0; // Only the calling thread writes progress
+            for (int k = next_tile++; k < tile_count; k = next_tile++) {
+                if (reports)
+                    std::clog << "\rTiles remaining: " << (tile_count - k) << ' ' << std::flush;
+                TRACE_SCOPE_INDEX("tile", k);
+                tile_time done;
+                done.x = (k % tiles_across) * tile;
+                done.y = first + (k / tiles_across) * tile;
+                done.width = std::min(tile, image_width - done.x);
+                done.height = std::min(tile, last - done.y);
+                done.thread = worker;
+
+                auto tile_start = clock::now();
+                render_tile(world, done, first, target, costs, first_sample, last_sample, features, adaptive_pixels);
+                done.ms = std::chrono::duration<double, std::milli>(clock::now() - tile_start).count();
+                tiles_done[worker].push_back(done);
+            }
+            finish_ms[worker] = std::chrono::duration<double, std::milli>(clock::now() - band_start).count();
+        };
+
+        std::vector<std::thread> pool;
+        for (int t = 1; t < workers; t++)
+            pool.emplace_back([&work, t] {
+                TRACE_THREAD_NAME("render worker");
+                work(t);
+            });
+        work(0);
+        for (auto& thread : pool) thread.join();
+
+        double band_ms = std::chrono::duration<double, std::milli>(clock::now() - band_start).count();
+        profile.wall_ms += band_ms;
+        profile.tail_ms += band_ms - *std::min_element(finish_ms.begin(), finish_ms.end());
+        for (int t = 0; t < workers; t++) {
+            for (const tile_time& done : tiles_done[t]) {
+                profile.busy_ms[t] += done.ms;
+                profile.tiles.push_back(done);
+            }
+        }
+    }
+
+    /**
+     * Renders the samples [first_sample, last_sample) of the pixels of one tile, given in image
+     * coordinates, into target, whose row 0 is image row first. Adaptive sampling, when allowed by
+     * adaptive_pixels, only applies to whole renders, which start at sample 0. First hits go to
+     * features, at image coordinates.
+     */
+    void render_tile(const hittable& world, const tile_time& tile, int first, hdr_framebuffer& target,
+                     cost_buffer* costs, int first_sample, int last_sample, feature_buffer* features,
+                     bool adaptive_pixels) const {
+        const bool timed = costs != nullptr && heatmap == heatmap_time;
+        std::chrono::steady_clock::time_point pixel_start;
+        std::unique_ptr<sampler> pixel_sampler = make_sampler(sampling, seed);
+
+        for (int j = tile.y; j < tile.y + tile.height; ++j) {
+            for (int i = tile.x; i < tile.x + tile.width; ++i) {
+                if (timed)
+                    pixel_start = std::chrono::steady_clock::now();
+                uint64_t tests_start = render_stats::local().primitive_tests;
+
+                int samples = adaptive_pixels && adaptive() && first_sample == 0
+                            ? render_pixel_adaptive(world, i, j, j - first, target, *pixel_sampler, features)
+                            : render_pixel(world, i, j, j - first, target, *pixel_sampler, first_sample, last_sample, features);
+
+                if (costs == nullptr) continue;
+                if (timed)
+                    costs->at(i, j) += std::chrono::duration<float, std::micro>(std::chrono::steady_clock::now() - pixel_start).count();
+                else if (heatmap == heatmap_samples)
+                    costs->at(i, j) += static_cast<float>(samples);
+                else
+                    costs->at(i, j) += static_cast<float>(render_stats::local().primitive_tests - tests_start);
+            }
+        }
+    }
+
+    bool adaptive() const { return min_samples_per_pixel > 0 && min_samples_per_pixel < samples_per_pixel; }
+
+    /**
+     * Adds the samples [first_sample, last_sample) of the image pixel i, j to the pixel i, row of
+     * target. Each sample starts the sampler at the pixel and its index, so the samples are the
+     * same whichever pass or thread renders them. When features is given, the first hit of each
+     * sample is added to its pixel i, j.
+     *
+     * @return the number of samples taken
+     */
+    int render_pixel(const hittable& world, int i, int j, int row, hdr_framebuffer& target, sampler& s,
+                     int first_sample, int last_sample, feature_buffer* features) const {
+        first_hit hit;
+        for (int sample = first_sample; sample < last_sample; ++sample) {
+            s.start_sample(i, j, first_frame_sample + sample);
+            ray r = get_ray(i, j, s);
+            render_stats::count_primary_ray();
+            target.add_sample(i, row, ray_color(r, max_depth, world, s, 0, features ? &hit : nullptr));
+            if (features) features->add_sample(i, j, hit);
+        }
+        return last_sample - first_sample;
+    }
+
+    /**
+     * Samples the image pixel i, j until its noise falls below noise_threshold, taking at least
+     * min_samples_per_pixel and at most samples_per_pixel samples, and adds them to the pixel
+     * i, row of target.
+     *
+     * The variance of the sample luminance is tracked as the samples come in (Welford's method).
+     * The noise is the standard error of the mean luminance carried through the square root gamma
+     * of tone_map, so dark pixels, where the eye sees small differences, need a smaller error than
+     * bright ones. It is checked every few samples rather than after each one, which keeps a
+     * lucky streak of samples from stopping a pixel early.
+     *
+     * @return the number of samples taken
+     */
+    int render_pixel_adaptive(const hittable& world, int i, int j, int row, hdr_framebuffer& target, sampler& s,
+                              feature_buffer* features) const {
+        first_hit hit;
+        const int step = std::max(4, min_samples_per_pixel / 2);
+        double mean = 0, squared_deviations = 0;
+
+        int n = 0;
+        while (n < samples_per_pixel) {
+            s.start_sample(i, j, first_frame_sample + n);
+            ray r = get_ray(i, j, s);
+            render_stats::count_primary_ray();
+            color sample = ray_color(r, max_depth, world, s, 0, features ? &hit : nullptr);
+            target.add_sample(i, row, sample);
+            if (features) features->add_sample(i, j, hit);
+
+            double value = exposure * luminance(sample);
+            ++n;
+            double delta = value - mean;
+            mean += delta / n;
+            squared_deviations += delta * (value - mean);
+
+            if (n >= min_samples_per_pixel && (n - min_samples_per_pixel) % step == 0) {
+                double standard_error = std::sqrt(squared_deviations / (n - 1) / n);
+                double displayed_error = standard_error / (2 * std::sqrt(std::max(mean, 1e-4)));
+                if (displayed_error < noise_threshold) break;
+            }
+        }
+        return n;
+    }
+
+     ray get_ray(int i, int j, sampler& s) const {
         // Get a randomly sampled camera ray for the pixel at location i,j.
 
         auto pixel_center = pixel00_loc + (i * pixel_delta_u) + (j * pixel_delta_v);
-        auto pixel_sample = pixel_center + pixel_sample_square();
+        auto pixel_sample = pixel_center + pixel_sample_square(s.get_2d());
 
         auto ray_origin = center;
         auto ray_direction = pixel_sample - ray_origin;
 
-        return ray(ray_origin, ray_direction);
+        return ray(ray_origin, ray_direction, ray_camera, cull_back_faces ? ray_cull_back_faces : 0);
     }
 
-    vec3 pixel_sample_square() const {
-        // Returns a random point in the square surrounding a pixel at the origin.
-        auto px = -0.5 + random_double();
-        auto py = -0.5 + random_double();
+    vec3 pixel_sample_square(const sample_2d& offset) const {
+        // Returns the point of the square surrounding a pixel at the origin given by offset.
+        auto px = -0.5 + offset.u;
+        auto py = -0.5 + offset.v;
         return (px * pixel_delta_u) + (py * pixel_delta_v);
     }
 
-    color ray_color(const ray& r, int depth, const hittable& world) const {
+    /**
+     * Traces a path and returns the light it carries back along r.
+     *
+     * At diffuse bounces, when there are lights, a shadow ray toward a light sample is added to
+     * the scattered path. Both can find the same light, so each is weighed by the power heuristic
+     * of multiple importance sampling, and a light reached by the scattered ray is scaled by the
+     * weight of scatter_pdf against the light's density.
+     *
+     * @param scatter_pdf the density with which a diffuse bounce drew r, 0 for camera and mirror rays
+     * @param first receives what r hits, when given
+     */
+    color ray_color(const ray& r, int depth, const hittable& world, sampler& s, double scatter_pdf = 0,
+                    first_hit* first = nullptr) const {
         hit_record rec;
 
         // If we've exceeded the ray bounce limit, no more light is gathered.
-        if (depth <= 0)
+        if (depth <= 0) {
+            render_stats::count_path(max_depth - depth);
             return color(0,0,0);
+        }
 
         if (world.hit(r, interval(0.001, infinity), rec)) {
+            if (first) {
+                first->albedo = rec.mat->base_color();
+                first->normal = rec.normal;
+                first->depth = rec.t * r.direction().length();
+                first->position = rec.p;
+                first->object_id = rec.object_id;
+                first->material_id = rec.mat->id;
+            }
+
+            color emitted = rec.mat->emitted(r, rec);
+            if (scatter_pdf > 0 && emitted != color(0,0,0))
+                emitted *= power_heuristic(scatter_pdf, lights->pdf_value(r.origin(), r.direction()));
+
+            bool sample_lights = lights && rec.mat->diffuse();
+            if (sample_lights)
+                emitted += light_sample(r, rec, world, s);
+
             ray scattered;
             color attenuation;
-            if (rec.mat->scatter(r, rec, attenuation, scattered))
-                return attenuation * ray_color(scattered, depth-1, world);
-            return color(0,0,0);
+            if (rec.mat->scatter(r, rec, attenuation, scattered, s)) {
+                render_stats::count_secondary_ray();
+                if (cull_back_faces) {
+                    // A ray going into the object, or staying inside it, must still see its back faces
+                    vec3 outward = rec.front_face ? rec.normal : -rec.normal;
+                    bool outside = dot(scattered.direction(), outward) > 0;
+                    scattered = ray(scattered.origin(), scattered.direction(), ray_secondary,
+                                    outside ? ray_cull_back_faces : 0);
+                }
+                double pdf = sample_lights ? rec.mat->scattering_pdf(r, rec, scattered.direction()) : 0;
+                return emitted + attenuation * ray_color(scattered, depth-1, world, s, pdf);
+            }
+            render_stats::count_path(max_depth - depth);
+            return emitted;
         }
 
+        render_stats::count_path(max_depth - depth);
+
         vec3 unit_direction = unit_vector(r.direction());
         auto a = 0.5*(unit_direction.y() + 1.0);
-        return (1.0-a)*color(1.0, 1.0, 1.0) + a*color(0.5, 0.7, 1.0);
+        color sky = sky_brightness * ((1.0-a)*color(1.0, 1.0, 1.0) + a*color(0.5, 0.7, 1.0));
+        if (first) *first = first_hit{sky, vec3(0,0,0), first_hit::miss_depth,
+                                      r.origin() + first_hit::miss_depth * unit_direction};
+        return sky;
+    }
+
+    /**
+     * Sends a shadow ray from a diffuse hit toward a point drawn on the lights.
+     *
+     * @return the light arriving along it, reflected toward the origin of r and weighed against
+     * the chance that scatter would have drawn the same direction
+     */
+    color light_sample(const ray& r, const hit_record& rec, const hittable& world, sampler& s) const {
+        vec3 direction = lights->random(rec.p, s);
+        double light_pdf = lights->pdf_value(rec.p, direction);
+        if (light_pdf <= 0) return color(0,0,0);
+
+        color reflected = rec.mat->evaluate(r, rec, direction);
+        if (reflected == color(0,0,0)) return color(0,0,0);
+
+        render_stats::count_shadow_ray();
+        ray shadow(rec.p, direction, ray_shadow);
+        hit_record light_rec;
+        if (!lights->hit(shadow, interval(0.001, infinity), light_rec)) return color(0,0,0);
+
+        color emitted = light_rec.mat->emitted(shadow, light_rec);
+        if (emitted == color(0,0,0)) return color(0,0,0);
+
+        // Any opaque object in front of the light blocks it, whichever is closest. Light passes
+        // straight through glass, standing in for the caustic the bounces rarely find
+        ray blocker(rec.p, direction, ray_shadow, ray_opaque_only | ray_terminate_on_first_hit);
+        if (world.occluded(blocker, interval(0.001, light_rec.t - 0.001))) return color(0,0,0);
+
+        double weight = power_heuristic(light_pdf, rec.mat->scattering_pdf(r, rec, direction));
+        return reflected * emitted * (weight / light_pdf);
+    }
+
+    static double power_heuristic(double pdf, double other_pdf) {
+        return pdf * pdf / (pdf * pdf + other_pdf * other_pdf);
     }
 };
 
@@ -17,15 +17,15 @@ inline double linear_to_gamma(double linear_component)
 }
 
 /**
- * @brief Writes P3 PPM color values to the output stream
- * 
- * This function takes a color vector and writes the color values to the specified output stream
- * in the P3 PPM format.
+ * @brief Converts an accumulated color to its [0,255] components
  *
- * @param out The output stream where the P3 PPM color values will be written.
- * @param pixel_color The color vector to be written in P3 PPM format.
+ * The color is divided by the number of samples, gamma corrected and clamped.
+ *
+ * @param pixel_color The sum of all samples of the pixel.
+ * @param samples_per_pixel The number of samples summed in pixel_color.
+ * @param rgb The array that receives the red, green and blue bytes.
  */
-void write_color(std::ostream &out, color pixel_color, int samples_per_pixel) {
+inline void color_to_bytes(color pixel_color, int samples_per_pixel, unsigned char rgb[3]) {
     auto r = pixel_color.x();
     auto g = pixel_color.y();
     auto b = pixel_color.z();
@@ -41,11 +41,38 @@ void write_color(std::ostream &out, color pixel_color, int samples_per_pixel) {
     g = linear_to_gamma(g);
     b = linear_to_gamma(b);
 
-    // Write the translated [0,255] value of each color component.
+    // Translate to a [0,255] value of each color component.
     static const interval intensity(0.000, 0.999);
-    out << static_cast<int>(256 * intensity.clamp(r)) << ' '
-        << static_cast<int>(256 * intensity.clamp(g)) << ' '
-        << static_cast<int>(256 * intensity.clamp(b)) << '\n';
+    rgb[0] = static_cast<unsigned char>(256 * intensity.clamp(r));
+    rgb[1] = static_cast<unsigned char>(256 * intensity.clamp(g));
+    rgb[2] = static_cast<unsigned char>(256 * intensity.clamp(b));
+}
+
+/**
+ * @brief Writes P3 PPM color values to the output stream
+ * 
+ * This function takes a color vector and writes the color values to the specified output stream
+ * in the P3 PPM format.
+ *
+ * @param out The output stream where the P3 PPM color values will be written.
+ * @param pixel_color The color vector to be written in P3 PPM format.
+ */
+void write_color(std::ostream &out, color pixel_color, int samples_per_pixel) {
+    unsigned char rgb[3];
+    color_to_bytes(pixel_color, samples_per_pixel, rgb);
+    out << static_cast<int>(rgb[0]) << ' '
+        << static_cast<int>(rgb[1]) << ' '
+        << static_cast<int>(rgb[2]) << '\n';
+}
+
+/**
+ * @brief Writes binary RGB color values to a pixel of a framebuffer
+ *
+ * @param out Pointer to the 3 bytes of the pixel.
+ * @param pixel_color The color vector to be written.
+ */
+inline void write_color(unsigned char* out, color pixel_color, int samples_per_pixel) {
+    color_to_bytes(pixel_color, samples_per_pixel, out);
 }
 
 #endif
\ No newline at end of file
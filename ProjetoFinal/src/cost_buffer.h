@@ -0,0 +1,110 @@
+/**
+ * @file cost_buffer.h
+ * @brief Contains the cost_buffer class, which records how expensive each pixel was to render
+ */
+#ifndef COST_BUFFER_H
+#define COST_BUFFER_H
+
+#include <algorithm>
+#include <vector>
+
+#include "framebuffer.h"
+
+/**
+ * @brief What the camera records in its cost_buffer while rendering.
+ */
+enum heatmap_mode {
+    heatmap_off = 0, // Nothing is recorded
+    heatmap_time,    // Microseconds spent on each pixel
+    heatmap_tests,   // Ray-primitive intersection tests made for each pixel
+    heatmap_samples  // Samples taken for each pixel, which vary with adaptive sampling
+};
+
+/**
+ * @class cost_buffer
+ * @brief Holds one cost value per pixel and turns it into a false color image.
+ *
+ * @param width The width of the image in pixels.
+ * @param height The height of the image in pixels.
+ */
+class cost_buffer {
+  public:
+    cost_buffer() {}
+    cost_buffer(int _width, int _height) { resize(_width, _height); }
+
+    void resize(int _width, int _height) {
+        width = _width;
+        height = _height;
+        costs.assign(static_cast<size_t>(width) * height, 0.0f);
+    }
+
+    void clear() { std::fill(costs.begin(), costs.end(), 0.0f); }
+
+    int get_width() const { return width; }
+    int get_height() const { return height; }
+
+    float& at(int i, int j) { return costs[static_cast<size_t>(j) * width + i]; }
+    float at(int i, int j) const { return costs[static_cast<size_t>(j) * width + i]; }
+
+    /**
+     * @return the sum of the costs of all pixels
+     */
+    double total() const {
+        double sum = 0;
+        for (float cost : costs) sum += cost;
+        return sum;
+    }
+
+    /**
+     * @brief Maps the costs to colors, from black (cheap) through purple and orange to pale yellow.
+     *
+     * The scale is set by the 99th percentile instead of the maximum, so a few outlier pixels
+     * do not push everything else to black.
+     *
+     * @param out the image that receives the colors, resized to match
+     *
+     * @return the cost shown at the top of the scale
+     */
+    float to_image(framebuffer& out) const {
+        if (out.get_width() != width || out.get_height() != height)
+            out.resize(width, height);
+        if (costs.empty()) return 0.0f;
+
+        std::vector<float> sorted(costs);
+        size_t rank = (sorted.size() - 1) * 99 / 100;
+        std::nth_element(sorted.begin(), sorted.begin() + rank, sorted.end());
+        float scale = sorted[rank] > 0.0f ? sorted[rank] : 1.0f;
+
+        for (int j = 0; j < height; j++) {
+            for (int i = 0; i < width; i++) {
+                float t = std::min(1.0f, at(i, j) / scale);
+                false_color(t, out.pixel(i, j));
+            }
+        }
+        return scale;
+    }
+
+  private:
+    int width = 0;
+    int height = 0;
+    std::vector<float> costs;
+
+    /**
+     * Interpolates an inferno like gradient at t in [0, 1].
+     */
+    static void false_color(float t, unsigned char rgb[3]) {
+        static const float stops[][3] = {
+            {  0,   0,   4}, { 40,  11,  84}, {101,  21, 110}, {159,  42,  99},
+            {212,  72,  66}, {245, 125,  21}, {250, 193,  39}, {252, 255, 164}
+        };
+        const int last = sizeof(stops) / sizeof(stops[0]) - 1;
+
+        float position = t * last;
+        int k = std::min(last - 1, static_cast<int>(position));
+        float f = position - k;
+        for (int c = 0; c < 3; c++)
+            rgb[c] = static_cast<unsigned char>(stops[k][c] + f * (stops[k + 1][c] - stops[k][c]) + 0.5f);
+    }
+};
+
+#endif
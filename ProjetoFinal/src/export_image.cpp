@@ -1,70 +1,258 @@
 /**
  * @file
- * @brief This file contains functions for saving images to P3 PPM and PNG formats.
+ * @brief This file contains functions for saving framebuffers to PNG, P6 PPM and P3 PPM formats,
+ * floating point framebuffers to PFM and OpenEXR formats, and the first hits of the camera rays
+ * as auxiliary outputs (AOVs) to OpenEXR layers, PFM files or PNG previews.
  */
 
+#include <algorithm>
+#include <cstdio>
 #include <iostream>
-#include <sstream>
 #include <string>
 #include <fstream>
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 #include "stb_image_write.h"
 
+#include "framebuffer.h"
+#include "hdr_framebuffer.h"
+#include "feature_buffer.h"
+#include "exr_writer.h"
+#include "png_writer.h"
+#include "util/trace.h"
+
 /**
- * @brief Converts a P3 PPM image data to a P6 PPM image data.
+ * @brief Saves a framebuffer as a PNG file.
  *
- * This function takes P3 PPM image data as input and converts it to P6 format.
- * The P3 format uses ASCII text, while P6 format uses binary data. This is then used 
- * when saving the image to png, since stb_image_write.h requires binary PPM.
+ * The image is filtered and compressed in parallel stripes by write_png_parallel, at the same
+ * compression level stb_image_write.h would use.
  *
- * @param data The input P3 PPM image data.
- * @return The converted P6 PPM image data in binary format.
+ * @param filename The name of the PNG file to be saved.
+ * @param image The framebuffer to be saved.
  */
-std::string convertToP6(std::string data) {
-    std::istringstream ppmStream(data);
-    std::ostringstream outputP6;
-
-    std::string _;
-    ppmStream >> _ >> _ >> _ >> _;
-
-    int red, green, blue;
-    while (ppmStream >> red >> green >> blue) {        
-        outputP6.put(static_cast<char>(red));
-        outputP6.put(static_cast<char>(green));
-        outputP6.put(static_cast<char>(blue));
+void saveToPng(std::string filename, const framebuffer& image) {
+    TRACE_SCOPE("saveToPng");
+    if (!write_png_parallel(filename, image, 0, stbi_write_png_compression_level)) {
+        // Handle the error if the image couldn't be saved.
+        printf("Error: Could not save the image to PNG format.\n");
     }
-
-    return outputP6.str();
 }
 
 /**
- * @brief Saves P3 PPM image data as a PNG file.
- *
- * This function converts the P3 PPM image data to binary format and saves it as a PNG file.
- * The width and height of the image are specified, along with the output file name.
+ * @brief Saves a framebuffer as a binary P6 PPM file.
  *
- * @param filename The name of the PNG file to be saved.
- * @param width The width of the image.
- * @param height The height of the image.
- * @param data The P3 PPM image data in ASCII format.
+ * @param filename The name of the P6 PPM file to be saved.
+ * @param image The framebuffer to be saved.
  */
-void saveToPng(std::string filename, int width, int height, std::string data) {
-    std::string p6String = convertToP6(data);
-    if (stbi_write_png(filename.c_str(), width, height, 3, p6String.c_str(), width * 3) == 0) {
-        // Handle the error if the image couldn't be saved.
-        printf("Error: Could not save the image to PNG format.\n");
+void saveToP6(std::string filename, const framebuffer& image) {
+    std::ofstream ppm_file(filename, std::ios::binary);
+    if (!ppm_file) {
+        printf("Error: Could not save the image to P6 PPM format.\n");
+        return;
     }
+
+    ppm_file << "P6\n" << image.get_width() << ' ' << image.get_height() << "\n255\n";
+    ppm_file.write(reinterpret_cast<const char*>(image.data()), image.size());
 }
 
 /**
- * @brief Saves PPM image data to a file.
+ * @brief Saves a framebuffer as an ASCII P3 PPM file.
  *
- * This function takes P3 PPM image data and saves it to a file with the specified filename.
+ * This is an optional export for tools that need the text format, the renderer itself never
+ * goes through it.
  *
  * @param filename The name of the P3 PPM file to be saved.
- * @param data The PPM image data to be saved.
+ * @param image The framebuffer to be saved.
  */
-void saveToPPM(std::string filename, std::string data) {
+void saveToPPM(std::string filename, const framebuffer& image) {
     std::ofstream ppm_file(filename);
-    ppm_file << data;
-}
\ No newline at end of file
+    if (!ppm_file) {
+        printf("Error: Could not save the image to P3 PPM format.\n");
+        return;
+    }
+
+    ppm_file << "P3\n" << image.get_width() << ' ' << image.get_height() << "\n255\n";
+
+    const unsigned char* bytes = image.data();
+    for (size_t k = 0; k < image.size(); k += 3) {
+        ppm_file << static_cast<int>(bytes[k]) << ' '
+                 << static_cast<int>(bytes[k + 1]) << ' '
+                 << static_cast<int>(bytes[k + 2]) << '\n';
+    }
+}
+
+/**
+ * @brief Saves the mean linear color of a floating point framebuffer as a PFM file.
+ *
+ * PFM stores little endian RGB floats with the bottom row first.
+ *
+ * @param filename The name of the PFM file to be saved.
+ * @param image The floating point framebuffer to be saved.
+ */
+void saveToPfm(std::string filename, const hdr_framebuffer& image) {
+    std::ofstream pfm_file(filename, std::ios::binary);
+    if (!pfm_file) {
+        printf("Error: Could not save the image to PFM format.\n");
+        return;
+    }
+
+    const int width = image.get_width();
+    const int height = image.get_height();
+    std::vector<float> rgba = image.resolve();
+
+    pfm_file << "PF\n" << width << ' ' << height << "\n-1.0\n";
+
+    std::vector<float> row(static_cast<size_t>(width) * 3);
+    for (int j = height - 1; j >= 0; j--) {
+        for (int i = 0; i < width; i++) {
+            const float* p = &rgba[(static_cast<size_t>(j) * width + i) * 4];
+            row[i * 3]     = p[0];
+            row[i * 3 + 1] = p[1];
+            row[i * 3 + 2] = p[2];
+        }
+        pfm_file.write(reinterpret_cast<const char*>(row.data()), row.size() * sizeof(float));
+    }
+}
+
+/**
+ * @brief Saves the mean linear RGBA of a floating point framebuffer as an OpenEXR file.
+ *
+ * With aovs, the averaged first hits are written as further layers of the same file: albedo.R,
+ * albedo.G, albedo.B, normal.X, normal.Y, normal.Z, depth.Z, position.X, position.Y, position.Z,
+ * object.id and material.id.
+ *
+ * @param filename The name of the EXR file to be saved.
+ * @param image The floating point framebuffer to be saved.
+ * @param compression Whether the scanlines are stored raw or run length encoded.
+ * @param aovs The first hits of the same image, averaged, or null for the color alone.
+ */
+void saveToExr(std::string filename, const hdr_framebuffer& image, exr_compression compression = exr_rle_compression,
+               const feature_buffer* aovs = nullptr) {
+    std::vector<float> rgba = image.resolve();
+
+    std::vector<exr_channel> channels = {
+        exr_channel("R", rgba.data(), 4),
+        exr_channel("G", rgba.data() + 1, 4),
+        exr_channel("B", rgba.data() + 2, 4),
+        exr_channel("A", rgba.data() + 3, 4)
+    };
+    if (aovs) {
+        const char* names[feature_buffer::channel_count] = {
+            "albedo.R", "albedo.G", "albedo.B", "normal.X", "normal.Y", "normal.Z", "depth.Z",
+            "position.X", "position.Y", "position.Z", "object.id", "material.id"
+        };
+        for (int c = 0; c < feature_buffer::channel_count; c++)
+            channels.push_back(exr_channel(names[c], aovs->plane(static_cast<feature_buffer::channel>(c)), 1));
+    }
+
+    if (!write_exr(filename, image.get_width(), image.get_height(), channels, compression))
+        printf("Error: Could not save the image to EXR format.\n");
+}
+
+/**
+ * @brief Writes one or three planes of floats as a grayscale or RGB PFM file, bottom row first.
+ *
+ * @return false if the file could not be written
+ */
+static bool writePfmPlanes(const std::string& filename, int width, int height, const std::vector<const float*>& planes) {
+    std::ofstream pfm_file(filename, std::ios::binary);
+    if (!pfm_file)
+        return false;
+
+    pfm_file << (planes.size() == 1 ? "Pf\n" : "PF\n") << width << ' ' << height << "\n-1.0\n";
+
+    std::vector<float> row(static_cast<size_t>(width) * planes.size());
+    for (int j = height - 1; j >= 0; j--) {
+        for (int i = 0; i < width; i++) {
+            for (size_t c = 0; c < planes.size(); c++)
+                row[i * planes.size() + c] = planes[c][static_cast<size_t>(j) * width + i];
+        }
+        pfm_file.write(reinterpret_cast<const char*>(row.data()), row.size() * sizeof(float));
+    }
+    return static_cast<bool>(pfm_file);
+}
+
+/**
+ * @brief Saves the averaged first hits of an image as PFM files, one per output: the albedo,
+ * normal and position as RGB, the depth and the object and material ids as grayscale.
+ *
+ * @param file_name The output file name, without extension; each output adds its own suffix,
+ * such as _depth.pfm.
+ * @param aovs The averaged first hits to be saved.
+ */
+void saveAovsToPfm(std::string file_name, const feature_buffer& aovs) {
+    const int width = aovs.get_width();
+    const int height = aovs.get_height();
+    auto plane = [&](feature_buffer::channel c) { return aovs.plane(c); };
+
+    bool saved = writePfmPlanes(file_name + "_albedo.pfm", width, height,
+                                {plane(feature_buffer::albedo_r), plane(feature_buffer::albedo_g), plane(feature_buffer::albedo_b)})
+              && writePfmPlanes(file_name + "_normal.pfm", width, height,
+                                {plane(feature_buffer::normal_x), plane(feature_buffer::normal_y), plane(feature_buffer::normal_z)})
+              && writePfmPlanes(file_name + "_depth.pfm", width, height, {plane(feature_buffer::depth)})
+              && writePfmPlanes(file_name + "_position.pfm", width, height,
+                                {plane(feature_buffer::position_x), plane(feature_buffer::position_y), plane(feature_buffer::position_z)})
+              && writePfmPlanes(file_name + "_object_id.pfm", width, height, {plane(feature_buffer::object_id)})
+              && writePfmPlanes(file_name + "_material_id.pfm", width, height, {plane(feature_buffer::material_id)});
+    if (!saved)
+        printf("Error: Could not save the AOVs to PFM format.\n");
+}
+
+/**
+ * @brief Saves previews of the averaged first hits of an image as PNG files.
+ *
+ * The albedo is gamma corrected like the image, the normals are mapped from [-1,1] to [0,1], the
+ * depth is shown as the nearest depth over the depth of each pixel, gamma corrected, so the nearest
+ * surface is white and the sky black, and every object and material id gets its own color, with
+ * black for none. The position has no meaningful 8 bit
+ * form, so it is only saved by the floating point formats.
+ *
+ * @param file_name The output file name, without extension; each preview adds its own suffix,
+ * such as _depth.png.
+ * @param aovs The averaged first hits to be saved.
+ */
+void saveAovsToPng(std::string file_name, const feature_buffer& aovs) {
+    const int width = aovs.get_width();
+    const int height = aovs.get_height();
+    const size_t pixel_count = static_cast<size_t>(width) * height;
+    framebuffer preview(width, height);
+    unsigned char* bytes = preview.data();
+
+    auto to_byte = [](double value) {
+        return static_cast<unsigned char>(256.0 * std::min(std::max(value, 0.0), 0.999));
+    };
+    auto save_rgb = [&](const std::string& suffix, feature_buffer::channel first, double scale, double offset, bool gamma) {
+        for (size_t k = 0; k < pixel_count; k++) {
+            for (int c = 0; c < 3; c++) {
+                double value = scale * aovs.plane(static_cast<feature_buffer::channel>(first + c))[k] + offset;
+                bytes[k * 3 + c] = to_byte(gamma ? std::sqrt(std::max(value, 0.0)) : value);
+            }
+        }
+        saveToPng(file_name + suffix, preview);
+    };
+    auto save_ids = [&](const std::string& suffix, feature_buffer::channel c) {
+        for (size_t k = 0; k < pixel_count; k++) {
+            uint32_t id = static_cast<uint32_t>(aovs.plane(c)[k]);
+            uint32_t hash = id * 2654435761u; // Spreads consecutive ids over distinct colors
+            for (int b = 0; b < 3; b++)
+                bytes[k * 3 + b] = id == 0 ? 0 : static_cast<unsigned char>(((hash >> (8 * b + 8)) & 0xff) | 0x40);
+        }
+        saveToPng(file_name + suffix, preview);
+    };
+
+    save_rgb("_albedo.png", feature_buffer::albedo_r, 1.0, 0.0, true);
+    save_rgb("_normal.png", feature_buffer::normal_x, 0.5, 0.5, false);
+
+    // Misses, and pixels whose samples partly missed, are so far that they come out black
+    const float* depth = aovs.plane(feature_buffer::depth);
+    float nearest = static_cast<float>(first_hit::miss_depth);
+    for (size_t k = 0; k < pixel_count; k++)
+        if (depth[k] > 0) nearest = std::min(nearest, depth[k]);
+    for (size_t k = 0; k < pixel_count; k++) {
+        unsigned char value = depth[k] > 0 ? to_byte(std::sqrt(nearest / depth[k])) : 0;
+        bytes[k * 3] = bytes[k * 3 + 1] = bytes[k * 3 + 2] = value;
+    }
+    saveToPng(file_name + "_depth.png", preview);
+
+    save_ids("_object_id.png", feature_buffer::object_id);
+    save_ids("_material_id.png", feature_buffer::material_id);
+}
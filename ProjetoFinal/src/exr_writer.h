@@ -0,0 +1,239 @@
+/**
+ * @file exr_writer.h
+ * @brief Contains a dependency free writer for scanline OpenEXR files with 32 bit float channels
+ */
+#ifndef EXR_WRITER_H
+#define EXR_WRITER_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Compression modes supported by write_exr
+ */
+enum exr_compression {
+    exr_no_compression  = 0,
+    exr_rle_compression = 1
+};
+
+/**
+ * @class exr_channel
+ * @brief Describes one float channel of an image to be written to an EXR file.
+ *
+ * @param name The channel name, such as "R" or "normal.X".
+ * @param data Pointer to the first value of the channel, top row first.
+ * @param stride The distance, in floats, between two consecutive pixels of the channel.
+ */
+class exr_channel {
+  public:
+    exr_channel(std::string _name, const float* _data, int _stride) : name(_name), data(_data), stride(_stride) {}
+
+    std::string name;
+    const float* data;
+    int stride;
+};
+
+namespace exr_detail {
+
+inline void put_u32(std::vector<char>& out, uint32_t value) {
+    for (int b = 0; b < 4; b++) out.push_back(static_cast<char>((value >> (8 * b)) & 0xff));
+}
+
+inline void put_u64(std::vector<char>& out, uint64_t value) {
+    for (int b = 0; b < 8; b++) out.push_back(static_cast<char>((value >> (8 * b)) & 0xff));
+}
+
+inline void put_f32(std::vector<char>& out, float value) {
+    uint32_t bits;
+    std::memcpy(&bits, &value, 4);
+    put_u32(out, bits);
+}
+
+inline void put_string(std::vector<char>& out, const std::string& value) {
+    out.insert(out.end(), value.begin(), value.end());
+    out.push_back(0);
+}
+
+inline void put_attribute(std::vector<char>& out, const std::string& name, const std::string& type, const std::vector<char>& value) {
+    put_string(out, name);
+    put_string(out, type);
+    put_u32(out, static_cast<uint32_t>(value.size()));
+    out.insert(out.end(), value.begin(), value.end());
+}
+
+/**
+ * @brief OpenEXR run length encoding of a byte buffer
+ *
+ * Runs of 3 or more equal bytes are stored as (length - 1, value), other bytes are stored as
+ * (-length, bytes...). Runs are at most 127 bytes long.
+ */
+inline std::vector<char> rle_encode(const std::vector<unsigned char>& in) {
+    const int min_run = 3;
+    const int max_run = 127;
+    std::vector<char> out;
+    out.reserve(in.size() + in.size() / 64 + 2);
+
+    size_t run_start = 0;
+    size_t run_end = 1;
+    const size_t end = in.size();
+
+    while (run_start < end) {
+        while (run_end < end && in[run_start] == in[run_end] && run_end - run_start - 1 < static_cast<size_t>(max_run))
+            ++run_end;
+
+        if (run_end - run_start >= static_cast<size_t>(min_run)) {
+            out.push_back(static_cast<char>(run_end - run_start - 1));
+            out.push_back(static_cast<char>(in[run_start]));
+            run_start = run_end;
+        } else {
+            while (run_end < end
+                   && ((run_end + 1 >= end || in[run_end] != in[run_end + 1])
+                       || (run_end + 2 >= end || in[run_end + 1] != in[run_end + 2]))
+                   && run_end - run_start < static_cast<size_t>(max_run))
+                ++run_end;
+
+            out.push_back(static_cast<char>(-static_cast<int>(run_end - run_start)));
+            while (run_start < run_end)
+                out.push_back(static_cast<char>(in[run_start++]));
+        }
+        ++run_end;
+    }
+
+    return out;
+}
+
+/**
+ * @brief Applies the OpenEXR RLE preprocessing (byte interleaving and delta predictor) and encoding
+ */
+inline std::vector<char> rle_compress(const std::vector<char>& raw) {
+    const size_t size = raw.size();
+    std::vector<unsigned char> tmp(size);
+
+    // Split even and odd bytes into two halves
+    size_t first = 0;
+    size_t second = (size + 1) / 2;
+    for (size_t k = 0; k < size; k++) {
+        if (k % 2 == 0) tmp[first++] = static_cast<unsigned char>(raw[k]);
+        else            tmp[second++] = static_cast<unsigned char>(raw[k]);
+    }
+
+    // Store differences between consecutive bytes
+    int previous = size > 0 ? tmp[0] : 0;
+    for (size_t k = 1; k < size; k++) {
+        int d = static_cast<int>(tmp[k]) - previous + (128 + 256);
+        previous = tmp[k];
+        tmp[k] = static_cast<unsigned char>(d);
+    }
+
+    return rle_encode(tmp);
+}
+
+} // namespace exr_detail
+
+/**
+ * @brief Writes float channels to a single part scanline OpenEXR file.
+ *
+ * Channels are sorted by name as the format requires. Each block holds one scanline; with RLE
+ * compression a block that would not shrink is stored uncompressed, as the format allows.
+ *
+ * @param filename The name of the EXR file to be saved.
+ * @param width The width of the image.
+ * @param height The height of the image.
+ * @param channels The channels to be written.
+ * @param compression Whether scanlines are stored raw or run length encoded.
+ *
+ * @return true if the file was written
+ */
+inline bool write_exr(
+    const std::string& filename, int width, int height,
+    std::vector<exr_channel> channels, exr_compression compression = exr_rle_compression
+) {
+    using namespace exr_detail;
+
+    std::sort(channels.begin(), channels.end(),
+              [](const exr_channel& a, const exr_channel& b) { return a.name < b.name; });
+
+    std::vector<char> file;
+
+    // Magic number and version 2, single part scanline
+    put_u32(file, 20000630);
+    put_u32(file, 2);
+
+    std::vector<char> value;
+    for (const auto& channel : channels) {
+        put_string(value, channel.name);
+        put_u32(value, 2); // FLOAT
+        value.insert(value.end(), {0, 0, 0, 0}); // pLinear and reserved
+        put_u32(value, 1); // xSampling
+        put_u32(value, 1); // ySampling
+    }
+    value.push_back(0);
+    put_attribute(file, "channels", "chlist", value);
+
+    put_attribute(file, "compression", "compression", std::vector<char>{static_cast<char>(compression)});
+
+    value.clear();
+    put_u32(value, 0);
+    put_u32(value, 0);
+    put_u32(value, static_cast<uint32_t>(width - 1));
+    put_u32(value, static_cast<uint32_t>(height - 1));
+    put_attribute(file, "dataWindow", "box2i", value);
+    put_attribute(file, "displayWindow", "box2i", value);
+
+    put_attribute(file, "lineOrder", "lineOrder", std::vector<char>{0}); // INCREASING_Y
+
+    value.clear();
+    put_f32(value, 1.0f);
+    put_attribute(file, "pixelAspectRatio", "float", value);
+
+    value.clear();
+    put_f32(value, 0.0f);
+    put_f32(value, 0.0f);
+    put_attribute(file, "screenWindowCenter", "v2f", value);
+
+    value.clear();
+    put_f32(value, 1.0f);
+    put_attribute(file, "screenWindowWidth", "float", value);
+
+    file.push_back(0); // End of header
+
+    // Offset table, filled as the scanline blocks are appended
+    const size_t table_start = file.size();
+    file.resize(file.size() + 8 * static_cast<size_t>(height));
+
+    std::vector<char> line;
+    for (int y = 0; y < height; y++) {
+        line.clear();
+        for (const auto& channel : channels) {
+            const float* row = channel.data + static_cast<size_t>(y) * width * channel.stride;
+            for (int x = 0; x < width; x++)
+                put_f32(line, row[static_cast<size_t>(x) * channel.stride]);
+        }
+
+        const std::vector<char>* block = &line;
+        std::vector<char> compressed;
+        if (compression == exr_rle_compression) {
+            compressed = rle_compress(line);
+            if (compressed.size() < line.size())
+                block = &compressed;
+        }
+
+        std::vector<char> offset;
+        put_u64(offset, file.size());
+        std::copy(offset.begin(), offset.end(), file.begin() + table_start + 8 * static_cast<size_t>(y));
+
+        put_u32(file, static_cast<uint32_t>(y));
+        put_u32(file, static_cast<uint32_t>(block->size()));
+        file.insert(file.end(), block->begin(), block->end());
+    }
+
+    std::ofstream out(filename, std::ios::binary);
+    out.write(file.data(), file.size());
+    return static_cast<bool>(out);
+}
+
+#endif
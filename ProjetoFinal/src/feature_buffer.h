@@ -0,0 +1,116 @@
+/**
+ * @file feature_buffer.h
+ * @brief Contains the feature_buffer class, which records what the camera rays hit first
+ */
+#ifndef FEATURE_BUFFER_H
+#define FEATURE_BUFFER_H
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "util/rtweekend.h"
+
+/**
+ * @brief What a camera ray hit first: the base color and shading normal of the surface, the
+ * distance to it, where it is and the ids of the object and its material. Rays that hit nothing
+ * see the sky color, a zero normal, miss_depth, the point miss_depth along the ray and id 0.
+ */
+struct first_hit {
+    static constexpr double miss_depth = 1e6;
+
+    color albedo = color(0,0,0);
+    vec3 normal = vec3(0,0,0);
+    double depth = miss_depth;
+    point3 position = point3(0,0,0);
+    uint32_t object_id = 0;
+    uint32_t material_id = 0;
+};
+
+/**
+ * @class feature_buffer
+ * @brief Accumulates the first hits of the camera samples of every pixel, to guide filters and
+ * to be saved as auxiliary outputs.
+ *
+ * Each feature channel is a separate plane of floats, one per pixel, so filters can run over
+ * whole rows of a channel with vector instructions. The planes hold sums until average is called.
+ * Ids cannot be averaged, so the id planes hold the ids of the first sample of every pixel, as
+ * floats, which are exact up to 2^24.
+ *
+ * @param width The width of the image in pixels.
+ * @param height The height of the image in pixels.
+ */
+class feature_buffer {
+  public:
+    enum channel { albedo_r = 0, albedo_g, albedo_b, normal_x, normal_y, normal_z, depth,
+                   position_x, position_y, position_z, object_id, material_id, channel_count };
+    static constexpr int averaged_channels = object_id; // The channels before the ids
+
+    feature_buffer() {}
+    feature_buffer(int _width, int _height) { resize(_width, _height); }
+
+    void resize(int _width, int _height) {
+        width = _width;
+        height = _height;
+        for (auto& plane : planes)
+            plane.assign(static_cast<size_t>(width) * height, 0.0f);
+        counts.assign(static_cast<size_t>(width) * height, 0);
+    }
+
+    void clear() {
+        for (auto& plane : planes)
+            std::fill(plane.begin(), plane.end(), 0.0f);
+        std::fill(counts.begin(), counts.end(), 0);
+    }
+
+    int get_width() const { return width; }
+    int get_height() const { return height; }
+
+    /**
+     * Adds the first hit of one camera sample to the pixel at i, j.
+     */
+    void add_sample(int i, int j, const first_hit& hit) {
+        size_t index = static_cast<size_t>(j) * width + i;
+        planes[albedo_r][index] += static_cast<float>(hit.albedo.x());
+        planes[albedo_g][index] += static_cast<float>(hit.albedo.y());
+        planes[albedo_b][index] += static_cast<float>(hit.albedo.z());
+        planes[normal_x][index] += static_cast<float>(hit.normal.x());
+        planes[normal_y][index] += static_cast<float>(hit.normal.y());
+        planes[normal_z][index] += static_cast<float>(hit.normal.z());
+        planes[depth][index] += static_cast<float>(hit.depth);
+        planes[position_x][index] += static_cast<float>(hit.position.x());
+        planes[position_y][index] += static_cast<float>(hit.position.y());
+        planes[position_z][index] += static_cast<float>(hit.position.z());
+        if (counts[index] == 0) {
+            planes[object_id][index] = static_cast<float>(hit.object_id);
+            planes[material_id][index] = static_cast<float>(hit.material_id);
+        }
+        counts[index]++;
+    }
+
+    /**
+     * Divides every plane but the ids by the samples of each pixel, turning the sums into means.
+     * Pixels without samples are left at 0.
+     */
+    void average() {
+        for (size_t index = 0; index < counts.size(); index++) {
+            float scale = counts[index] == 0 ? 0.0f : 1.0f / counts[index];
+            for (int c = 0; c < averaged_channels; c++)
+                planes[c][index] *= scale;
+            counts[index] = counts[index] == 0 ? 0 : 1;
+        }
+    }
+
+    /**
+     * @return the values of a channel, one per pixel, top row first
+     */
+    const float* plane(channel c) const { return planes[c].data(); }
+
+  private:
+    int width = 0;
+    int height = 0;
+    std::vector<float> planes[channel_count];
+    std::vector<uint32_t> counts; // Samples per pixel
+};
+
+#endif
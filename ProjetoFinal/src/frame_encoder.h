@@ -0,0 +1,138 @@
+/**
+ * @file frame_encoder.h
+ * @brief Contains the frame_encoder class, which saves rendered frames to PNG on background threads
+ */
+#ifndef FRAME_ENCODER_H
+#define FRAME_ENCODER_H
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "framebuffer.h"
+#include "util/trace.h"
+
+/**
+ * @class frame_encoder
+ * @brief A bounded queue of finished frames drained by a pool of PNG encoding threads.
+ *
+ * The render loop hands a frame to submit and can start the next one right away. When the
+ * queue already holds `capacity` frames, submit blocks until an encoder takes one, so memory
+ * stays bounded if encoding falls behind rendering. Each encoder reports how long its frame
+ * took to encode.
+ *
+ * @param workers The number of encoding threads.
+ * @param capacity The maximum number of frames waiting to be encoded.
+ * @param report The stream the encoding times are written to, which must not be one that carries
+ * image data, such as a video on the standard output.
+ */
+class frame_encoder {
+  public:
+    frame_encoder(int workers = 1, size_t _capacity = 2, std::ostream& _report = std::cout)
+        : capacity(_capacity < 1 ? 1 : _capacity), report(_report) {
+        if (workers < 1) workers = 1;
+        for (int k = 0; k < workers; k++)
+            threads.emplace_back(&frame_encoder::work, this);
+    }
+
+    ~frame_encoder() { finish(); }
+
+    frame_encoder(const frame_encoder&) = delete;
+    frame_encoder& operator=(const frame_encoder&) = delete;
+
+    /**
+     * Queues a copy of a frame to be saved as a PNG file.
+     *
+     * @param image the frame to be saved
+     * @param file_name the name of the PNG file
+     * @param frame the frame number, used in the timing report
+     *
+     * @return the time spent waiting for room in the queue
+     */
+    std::chrono::milliseconds submit(const framebuffer& image, std::string file_name, int frame) {
+        TRACE_SCOPE_INDEX("encoder_submit", frame);
+        auto wait_start = std::chrono::steady_clock::now();
+
+        std::unique_lock<std::mutex> lock(mutex);
+        not_full.wait(lock, [this] { return jobs.size() < capacity; });
+        auto waited = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - wait_start);
+
+        jobs.push_back(job{image, file_name, frame});
+        lock.unlock();
+        not_empty.notify_one();
+
+        return waited;
+    }
+
+    /**
+     * Waits for every queued frame to be saved and stops the encoding threads.
+     */
+    void finish() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (stopping) return;
+            stopping = true;
+        }
+        not_empty.notify_all();
+        for (auto& thread : threads)
+            thread.join();
+        threads.clear();
+    }
+
+    /**
+     * @return the summed encoding time of all frames saved so far
+     */
+    std::chrono::milliseconds total_encoding_time() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return total_time;
+    }
+
+  private:
+    struct job {
+        framebuffer image;
+        std::string file_name;
+        int frame;
+    };
+
+    size_t capacity;
+    std::ostream& report;
+    std::vector<std::thread> threads;
+    std::deque<job> jobs;
+    std::mutex mutex;
+    std::condition_variable not_empty;
+    std::condition_variable not_full;
+    bool stopping = false;
+    std::chrono::milliseconds total_time{0};
+
+    void work() {
+        TRACE_THREAD_NAME("png encoder");
+        while (true) {
+            std::unique_lock<std::mutex> lock(mutex);
+            not_empty.wait(lock, [this] { return stopping || !jobs.empty(); });
+            if (jobs.empty()) return; // stopping and fully drained
+
+            job current = std::move(jobs.front());
+            jobs.pop_front();
+            lock.unlock();
+            not_full.notify_one();
+
+            auto start = std::chrono::steady_clock::now();
+            {
+                TRACE_SCOPE_INDEX("encode_frame", current.frame);
+                saveToPng(current.file_name, current.image);
+            }
+            auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+
+            lock.lock();
+            total_time += elapsed;
+            report << "Frame " << current.frame << " Encoding time: " << elapsed.count() << " ms." << std::endl;
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,58 @@
+/**
+ * @file framebuffer.h
+ * @brief Contains the framebuffer class, a contiguous 8 bit RGB image the camera renders into
+ */
+#ifndef FRAMEBUFFER_H
+#define FRAMEBUFFER_H
+
+#include <vector>
+
+#include "util/rtweekend.h"
+#include "color.h"
+
+/**
+ * @class framebuffer
+ * @brief Holds an image as tightly packed 8 bit RGB rows, top row first.
+ *
+ * The byte layout is the same one expected by stbi_write_png and by the body of a P6 PPM file,
+ * so the pixels can be handed to the image writers without any conversion.
+ *
+ * @param width The width of the image in pixels.
+ * @param height The height of the image in pixels.
+ */
+class framebuffer {
+  public:
+    framebuffer() {}
+    framebuffer(int _width, int _height) { resize(_width, _height); }
+
+    void resize(int _width, int _height) {
+        width = _width;
+        height = _height;
+        pixels.assign(static_cast<size_t>(width) * height * 3, 0);
+    }
+
+    int get_width() const { return width; }
+    int get_height() const { return height; }
+    int stride() const { return width * 3; }
+
+    unsigned char* data() { return pixels.data(); }
+    const unsigned char* data() const { return pixels.data(); }
+    size_t size() const { return pixels.size(); }
+
+    unsigned char* pixel(int i, int j) { return &pixels[(static_cast<size_t>(j) * width + i) * 3]; }
+    const unsigned char* pixel(int i, int j) const { return &pixels[(static_cast<size_t>(j) * width + i) * 3]; }
+
+    /**
+     * @brief Stores the averaged and gamma corrected color of the pixel at i, j
+     */
+    void set_pixel(int i, int j, color pixel_color, int samples_per_pixel) {
+        write_color(pixel(i, j), pixel_color, samples_per_pixel);
+    }
+
+  private:
+    int width = 0;
+    int height = 0;
+    std::vector<unsigned char> pixels;
+};
+
+#endif
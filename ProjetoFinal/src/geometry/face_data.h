@@ -39,7 +39,7 @@ public:
      *
      * @return a shared pointer to a triangle object
      */
-    shared_ptr<triangle> make_triangle(std::vector<point3> vertice_list, std::vector<vec3> normal_list, shared_ptr<material> mat) {
+    shared_ptr<triangle> make_triangle(const std::vector<point3>& vertice_list, const std::vector<vec3>& normal_list, shared_ptr<material> mat) const {
         mat3 points = mat3(
             vertice_list[A_index],
             vertice_list[B_index],
@@ -104,7 +104,7 @@ private:
 
 inline face_data read_format_a(std::string face_line) {
     char slash; // irrelevant
-    char texture_index; // irrelevant
+    int texture_index; // irrelevant
     face_data face;
 
     std::istringstream iss(face_line.substr(2));
@@ -133,7 +133,7 @@ inline face_data read_format_b(std::string face_line) {
 /**
  * @brief Parses a face line from an obj file and creates a face_data object
  * 
- * Formats accepted:
+ * Formats accepted, with any amount of whitespace between the vertices:
  * `f 1/1/1 2/2/2 3/3/3`
  * or
  * `f 1//1 2//2 3//3`
@@ -143,8 +143,8 @@ inline face_data read_format_b(std::string face_line) {
  * @return a face_data object
  */
 inline face_data from_obj_line(std::string face_line) {
-    std::regex format_a_pattern(R"(f \d+\/\d+\/\d+ \d+\/\d+\/\d+ \d+\/\d+\/\d+\r?)");
-    std::regex format_b_pattern(R"(f \d+\/\/\d+ \d+\/\/\d+ \d+\/\/\d+\r?)");
+    std::regex format_a_pattern(R"(f\s+\d+\/\d+\/\d+\s+\d+\/\d+\/\d+\s+\d+\/\d+\/\d+\s*)");
+    std::regex format_b_pattern(R"(f\s+\d+\/\/\d+\s+\d+\/\/\d+\s+\d+\/\/\d+\s*)");
 
     if (std::regex_match(face_line, format_a_pattern)) 
         return read_format_a(face_line);
@@ -9,6 +9,7 @@
 
 #include "ray.h"
 #include "../util/rtweekend.h"
+#include "../util/sampler.h"
 
 class material; // Fix circular dependency issue
 
@@ -19,7 +20,8 @@ class material; // Fix circular dependency issue
  * This class holds the details of the intersection of a ray with a hittable object.
  * It includes the point of intersection, the normal at the intersection,
  * the parameter 't' from the ray equation, and a boolean indicating
- * whether the intersection was with the front face of the object.
+ * whether the intersection was with the front face of the object. object_id is the id of the
+ * outermost object hit that has one, which lists fill in on the way out.
  */
 class hit_record {
   public:
@@ -28,6 +30,7 @@ class hit_record {
     shared_ptr<material> mat;
     double t;
     bool front_face;
+    uint32_t object_id = 0;
 
     /**
      * Sets the hit record normal vector.
@@ -47,13 +50,63 @@ class hit_record {
  * @brief Abstract class representing any object that can be hit by a ray.
  *
  * This class provides an interface for objects that can be intersected by rays.
- * The `hit` method updates a `hit_record` object with details of the intersection.
+ * The `hit` method updates a `hit_record` object with details of the intersection. The `occluded`
+ * method only answers whether anything is in the way, which is all shadow rays need.
+ *
+ * Each object is seen only by the kinds of rays in its visibility mask, and rays flagged opaque only
+ * pass through objects that are not opaque. Lists check both before testing their objects, so an
+ * excluded object costs no intersection test, for example a large ground that cannot shadow
+ * anything or a light that camera rays should not see.
+ *
+ * Every object added to a list without an id gets its position in that list, from 1, so the
+ * objects of a scene can be told apart in the object id output of the camera. 0 means no id.
+ *
+ * Objects that can be lights also draw directions toward themselves: random picks a direction
+ * from origin to a point of the object and pdf_value is the density of that choice, per solid
+ * angle. Objects that cannot be sampled keep the defaults, whose density is 0.
  */
 class hittable {
   public:
+    uint8_t visibility = visible_to_all; // ray_kind bits of the rays that see the object
+    bool opaque = true;                  // False for objects light passes through, such as glass
+    uint32_t id = 0;                     // Identifies the object in the camera's outputs, 0 for none
+
     virtual ~hittable() = default;
 
+    /**
+     * @return whether r may hit the object, given its kind and flags
+     */
+    bool visible_to(const ray& r) const {
+        return (visibility & r.kind()) != 0 && (opaque || !r.has_flag(ray_opaque_only));
+    }
+
     virtual bool hit(const ray& r, interval ray_t, hit_record& rec) const = 0;
+
+    /**
+     * @return whether the object intersects r within ray_t
+     *
+     * Unlike hit, it may stop at the first intersection found, in any order, and computes no hit
+     * point, normal or material. Objects that can answer faster than hit override it; the others
+     * flag r terminate on first hit, so the lists they are made of stop at the first object hit.
+     */
+    virtual bool occluded(const ray& r, interval ray_t) const {
+        hit_record rec;
+        return hit(ray(r.origin(), r.direction(), r.kind(), r.flags() | ray_terminate_on_first_hit), ray_t, rec);
+    }
+
+    /**
+     * @return the density, per solid angle, with which random picks direction from origin
+     */
+    virtual double pdf_value(const point3& origin, const vec3& direction) const {
+        return 0.0;
+    }
+
+    /**
+     * @return a direction from origin toward the object, drawn from the sampler s
+     */
+    virtual vec3 random(const point3& origin, sampler& s) const {
+        return vec3(1, 0, 0);
+    }
 };
 
 #endif
\ No newline at end of file
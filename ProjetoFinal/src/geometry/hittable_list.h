@@ -8,6 +8,7 @@
 
 #include "hittable.h"
 
+#include <algorithm>
 #include <memory>
 #include <vector>
 
@@ -20,6 +21,12 @@ using std::make_shared;
  *
  * This class encapsulates a list of objects that can be hit by rays. It allows
  * adding objects to the list, clearing the list, and querying for ray-object intersections.
+ *
+ * Objects that the ray is not visible to are skipped, and rays flagged terminate on first hit
+ * stop at the first object hit, which is not always the closest.
+ *
+ * Objects added without an id are numbered by their position in the list, and a hit on an object
+ * with an id reports it, over the ids of whatever the object is made of.
  */
 class hittable_list : public hittable {
   public:
@@ -32,6 +39,7 @@ class hittable_list : public hittable {
 
     void add(shared_ptr<hittable> object) {
         objects.push_back(object);
+        if (object->id == 0) object->id = static_cast<uint32_t>(objects.size());
     }
 
     bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
@@ -40,15 +48,47 @@ class hittable_list : public hittable {
         auto closest_so_far = ray_t.max;
 
         for (const auto& object : objects) {
+            if (!object->visible_to(r)) continue;
+            temp_rec.object_id = 0;
             if (object->hit(r, interval(ray_t.min, closest_so_far), temp_rec)) {
                 hit_anything = true;
                 closest_so_far = temp_rec.t;
                 rec = temp_rec;
+                if (object->id != 0) rec.object_id = object->id;
+                if (r.has_flag(ray_terminate_on_first_hit)) break;
             }
         }
 
         return hit_anything;
     }
+
+    bool occluded(const ray& r, interval ray_t) const override {
+        for (const auto& object : objects) {
+            if (object->visible_to(r) && object->occluded(r, ray_t))
+                return true;
+        }
+
+        return false;
+    }
+
+    /**
+     * The mixture of the objects' densities, as random picks one of them with equal chances.
+     */
+    double pdf_value(const point3& origin, const vec3& direction) const override {
+        if (objects.empty()) return 0.0;
+
+        double sum = 0.0;
+        for (const auto& object : objects)
+            sum += object->pdf_value(origin, direction);
+        return sum / objects.size();
+    }
+
+    vec3 random(const point3& origin, sampler& s) const override {
+        if (objects.empty()) return vec3(1, 0, 0);
+
+        auto index = std::min(static_cast<size_t>(s.get_1d() * objects.size()), objects.size() - 1);
+        return objects[index]->random(origin, s);
+    }
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,76 @@
+/**
+ * @file instance.h
+ * @brief Contains the instance class, which places a shared copy of a hittable elsewhere in the scene
+ */
+#ifndef INSTANCE_H
+#define INSTANCE_H
+
+#include "hittable.h"
+#include "vec3.h"
+#include "../util/interval.h"
+#include "../util/rtweekend.h"
+
+/**
+ * @class instance
+ * @brief Shows a hittable rotated around the Y axis and moved, without copying its geometry.
+ *
+ * Rays are moved into the space of the shared object, and the hit point and normal are moved
+ * back, so any number of instances cost the memory of a single mesh.
+ *
+ * @param object The shared hittable.
+ * @param offset The translation applied after the rotation.
+ * @param angle The rotation around the Y axis, in degrees.
+ */
+class instance : public hittable {
+  public:
+    instance(shared_ptr<hittable> _object, vec3 _offset, double angle = 0) : object(_object), offset(_offset) {
+        auto radians = degrees_to_radians(angle);
+        sin_theta = sin(radians);
+        cos_theta = cos(radians);
+    }
+
+    bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
+        if (!object->visible_to(r)) return false;
+
+        // World space to object space
+        ray local(to_object(r.origin() - offset), to_object(r.direction()), r.kind(), r.flags());
+
+        if (!object->hit(local, ray_t, rec))
+            return false;
+
+        // Object space to world space
+        rec.p = to_world(rec.p) + offset;
+        rec.normal = to_world(rec.normal);
+        return true;
+    }
+
+    bool occluded(const ray& r, interval ray_t) const override {
+        if (!object->visible_to(r)) return false;
+        return object->occluded(ray(to_object(r.origin() - offset), to_object(r.direction()), r.kind(), r.flags()), ray_t);
+    }
+
+    // A rotation keeps solid angles, so the densities of the shared object apply unchanged
+    double pdf_value(const point3& origin, const vec3& direction) const override {
+        return object->pdf_value(to_object(origin - offset), to_object(direction));
+    }
+
+    vec3 random(const point3& origin, sampler& s) const override {
+        return to_world(object->random(to_object(origin - offset), s));
+    }
+
+  private:
+    shared_ptr<hittable> object;
+    vec3 offset;
+    double sin_theta;
+    double cos_theta;
+
+    vec3 to_object(const vec3& v) const {
+        return vec3(cos_theta * v.x() - sin_theta * v.z(), v.y(), sin_theta * v.x() + cos_theta * v.z());
+    }
+
+    vec3 to_world(const vec3& v) const {
+        return vec3(cos_theta * v.x() + sin_theta * v.z(), v.y(), -sin_theta * v.x() + cos_theta * v.z());
+    }
+};
+
+#endif
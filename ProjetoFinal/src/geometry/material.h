@@ -5,20 +5,76 @@
 #ifndef MATERIAL_H
 #define MATERIAL_H
 
+#include <atomic>
+#include <cstdint>
+
 #include "../util/rtweekend.h"
+#include "../util/sampler.h"
+#include "onb.h"
+#include "sampling.h"
 
 class hit_record;
 
 /**
  * @class material
  * @brief Abstract class representing a type of material and how it interacts with rays.
+ *
+ * scatter draws its random choices from the sampler of the pixel sample being traced, so they
+ * follow the camera's sampling sequence.
+ *
+ * Diffuse materials can also be evaluated in any direction, which lets the camera send shadow
+ * rays toward the lights and weigh them against the directions scatter draws. Mirror-like
+ * materials scatter in a single direction and are only sampled.
+ *
+ * Every material gets an id, counted from 1 in the order the program creates materials, which
+ * tells them apart in the material id output of the camera.
  */
 class material {
   public:
+    uint32_t id = next_id(); // Identifies the material in the camera's outputs
+
     virtual ~material() = default;
 
     virtual bool scatter(
-        const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered) const = 0;
+        const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered, sampler& s) const = 0;
+
+    /**
+     * @return the light the surface gives off toward the origin of r_in
+     */
+    virtual color emitted(const ray& r_in, const hit_record& rec) const {
+        return color(0,0,0);
+    }
+
+    /**
+     * @return the overall color of the surface, which guides filters such as the denoiser
+     */
+    virtual color base_color() const { return color(1,1,1); }
+
+    /**
+     * @return whether evaluate and scattering_pdf describe the material
+     */
+    virtual bool diffuse() const { return false; }
+
+    /**
+     * @return the fraction of the light arriving from direction that is reflected toward the origin
+     * of r_in, times the cosine between direction and the normal
+     */
+    virtual color evaluate(const ray& r_in, const hit_record& rec, const vec3& direction) const {
+        return color(0,0,0);
+    }
+
+    /**
+     * @return the density, per solid angle, with which scatter draws direction
+     */
+    virtual double scattering_pdf(const ray& r_in, const hit_record& rec, const vec3& direction) const {
+        return 0.0;
+    }
+
+  private:
+    static uint32_t next_id() {
+        static std::atomic<uint32_t> created(0);
+        return ++created;
+    }
 };
 
 /**
@@ -33,19 +89,28 @@ class lambertian : public material {
   public:
     lambertian(const color& a) : albedo(a) {}
 
-    bool scatter(const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered)
+    bool scatter(const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered, sampler& s)
     const override {
-        auto scatter_direction = rec.normal + random_unit_vector();
-        
-        // Catch degenerate scatter direction
-        if (scatter_direction.near_zero())
-            scatter_direction = rec.normal;
-
-        scattered = ray(rec.p, scatter_direction);
+        // Cosine weighted around the normal, the distribution of the reflected light
+        sample_2d p = s.get_2d();
+        scattered = ray(rec.p, onb(rec.normal).local(cosine_hemisphere(p.u, p.v)));
         attenuation = albedo;
         return true;
     }
 
+    bool diffuse() const override { return true; }
+
+    color base_color() const override { return albedo; }
+
+    color evaluate(const ray& r_in, const hit_record& rec, const vec3& direction) const override {
+        return albedo * scattering_pdf(r_in, rec, direction);
+    }
+
+    double scattering_pdf(const ray& r_in, const hit_record& rec, const vec3& direction) const override {
+        auto cosine = dot(rec.normal, unit_vector(direction));
+        return cosine < 0 ? 0 : cosine / pi;
+    }
+
   private:
     color albedo;
 };
@@ -59,19 +124,26 @@ class lambertian : public material {
  * 
  * This material reflects most light that hits it.The fuzz parameter determines how much
  * fuzziness is added to the reflected ray.  
+ *
+ * The fuzz is the roughness of a GGX microfacet distribution: the ray is reflected by a normal
+ * drawn around the surface normal, and absorbed when it would leave below the surface.
  */ 
 class metal : public material {
   public:
     metal(const color& a, double f) : albedo(a), fuzz(f < 1 ? f : 1) {}
 
-    bool scatter(const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered)
+    bool scatter(const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered, sampler& s)
     const override {
-        vec3 reflected = reflect(unit_vector(r_in.direction()), rec.normal);
-        scattered = ray(rec.p, reflected + fuzz*random_unit_vector());
+        sample_2d p = s.get_2d();
+        vec3 microfacet = onb(rec.normal).local(ggx_normal(p.u, p.v, fuzz));
+        vec3 reflected = reflect(unit_vector(r_in.direction()), microfacet);
+        scattered = ray(rec.p, reflected);
         attenuation = albedo;
         return (dot(scattered.direction(), rec.normal) > 0);
     }
 
+    color base_color() const override { return albedo; }
+
   private:
     color albedo;
     double fuzz;
@@ -91,7 +163,7 @@ class dielectric : public material {
   public:
     dielectric(double index_of_refraction) : ir(index_of_refraction) {}
 
-    bool scatter(const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered)
+    bool scatter(const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered, sampler& s)
     const override {
         attenuation = color(1.0, 1.0, 1.0);
         double refraction_ratio = rec.front_face ? (1.0/ir) : ir;
@@ -103,7 +175,7 @@ class dielectric : public material {
         bool cannot_refract = refraction_ratio * sin_theta > 1.0;
         vec3 direction;
 
-        if (cannot_refract || reflectance(cos_theta, refraction_ratio) > random_double())
+        if (cannot_refract || reflectance(cos_theta, refraction_ratio) > s.get_1d())
             direction = reflect(unit_direction, rec.normal);
         else
             direction = refract(unit_direction, rec.normal, refraction_ratio);
@@ -131,4 +203,36 @@ class dielectric : public material {
     }
 };
 
+/**
+ * @class diffuse_light
+ * @brief Represents a surface that gives off light evenly from its front face.
+ *
+ * @param emit The emitted radiance, which may be above 1 for bright, small lights
+ *
+ * It reflects nothing. Objects made of it should also be added to the scene's lights so the
+ * camera samples them directly.
+ */
+class diffuse_light : public material {
+  public:
+    diffuse_light(const color& e) : emit(e) {}
+
+    bool scatter(const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered, sampler& s)
+    const override {
+        return false;
+    }
+
+    color emitted(const ray& r_in, const hit_record& rec) const override {
+        return rec.front_face ? emit : color(0,0,0);
+    }
+
+    // The hue of the light, at most 1
+    color base_color() const override {
+        double brightest = std::max(emit.x(), std::max(emit.y(), emit.z()));
+        return brightest > 1 ? emit / brightest : emit;
+    }
+
+  private:
+    color emit;
+};
+
 #endif
@@ -6,6 +6,7 @@
 #ifndef OBJECT_H
 #define OBJECT_H
 
+#include <algorithm>
 #include <fstream>
 #include <sstream>
 #include <string>
@@ -19,15 +20,19 @@
 #include "hittable_list.h"
 #include "material.h"
 #include "face_data.h"
+#include "ply_reader.h"
+#include "../util/trace.h"
 
 using std::make_shared;
 using std::shared_ptr;
 
 /**
  * @class object
- * @brief Reads .obj files and stores geometric data such as vertices, normals, textures, and faces.
+ * @brief Reads .obj and binary .ply files and stores geometric data such as vertices, normals, textures, and faces.
  *
  * This class extends hittable and provides functionality to parse .obj file format and extract geometric data.
+ * Files ending in .ply are read with ply_reader into the same lists, so both kinds of mesh behave the same.
+ * As a light, a triangle is picked with a chance proportional to its area, then a point of it.
  */
 class object : public hittable {
     public:
@@ -38,7 +43,10 @@ class object : public hittable {
             vec3 _shift = vec3(),
             vec3 _rotation = vec3()
         ) : file_path(_file_path), mat(_material), scale_factor(_scale_factor), shift(_shift), rotation(_rotation) {
-            readObj();
+            if (is_ply())
+                ply_reader(file_path).read(vertice_list, normal_list, face_list);
+            else
+                readObj();
             calculate_origin();
             rotate(rotation, false);
             translate(shift);
@@ -46,6 +54,27 @@ class object : public hittable {
             generate_triangles();
         }
 
+        /**
+         * Builds an object from geometry made in code instead of read from a file.
+         *
+         * @param _vertice_list the vertices of the mesh
+         * @param _normal_list the vertex normals of the mesh
+         * @param _face_list the triangles, with zero based indices into both lists
+         * @param _material the material of every triangle
+         */
+        object(
+            std::vector<point3> _vertice_list,
+            std::vector<vec3> _normal_list,
+            std::vector<face_data> _face_list,
+            shared_ptr<material> _material
+        ) : mat(_material), scale_factor(1), vertice_list(std::move(_vertice_list)), normal_list(std::move(_normal_list)),
+            face_list(std::move(_face_list)) {
+            for (auto& face : face_list)
+                face.validate_indices(vertice_list.size(), normal_list.size());
+            object_origin = calculate_origin();
+            generate_triangles();
+        }
+
         bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
             if (triangle_list.hit(r, ray_t, rec))
                 return true;
@@ -53,6 +82,31 @@ class object : public hittable {
             return false;
         }
 
+        bool occluded(const ray& r, interval ray_t) const override {
+            return triangle_list.occluded(r, ray_t);
+        }
+
+        double pdf_value(const point3& origin, const vec3& direction) const override {
+            if (total_area <= 0) return 0.0;
+
+            // Every triangle the direction crosses could have been picked
+            double sum = 0.0;
+            for (size_t k = 0; k < triangle_list.objects.size(); k++) {
+                double area = area_cdf[k] - (k > 0 ? area_cdf[k - 1] : 0.0);
+                sum += area * triangle_list.objects[k]->pdf_value(origin, direction);
+            }
+            return sum / total_area;
+        }
+
+        vec3 random(const point3& origin, sampler& s) const override {
+            if (triangle_list.objects.empty()) return vec3(1, 0, 0);
+
+            double target = s.get_1d() * total_area;
+            size_t k = std::upper_bound(area_cdf.begin(), area_cdf.end(), target) - area_cdf.begin();
+            k = std::min(k, triangle_list.objects.size() - 1);
+            return triangle_list.objects[k]->random(origin, s);
+        }
+
         /**
          * Rotates the object using the given rotation vector.
          *
@@ -148,6 +202,8 @@ class object : public hittable {
         std::vector<vec3> texture_list;
         std::vector<face_data> face_list;
         hittable_list triangle_list;
+        std::vector<double> area_cdf; // Running sum of the triangle areas
+        double total_area = 0;
 
         vec3 rotate_x(vec3 target, double theta) {
             if (theta == 0) return target;
@@ -208,12 +264,29 @@ class object : public hittable {
          * Generates triangles based on the face data read, and material of the object.
          */
         void generate_triangles() {
+            TRACE_SCOPE("generate_triangles");
             triangle_list.clear();
-            for (auto face_data : face_list) {
-                triangle_list.add(face_data.make_triangle(vertice_list, normal_list, mat));
+            triangle_list.objects.reserve(face_list.size());
+            area_cdf.clear();
+            area_cdf.reserve(face_list.size());
+            total_area = 0;
+            for (const auto& face_data : face_list) {
+                auto face = face_data.make_triangle(vertice_list, normal_list, mat);
+                total_area += face->area();
+                area_cdf.push_back(total_area);
+                triangle_list.add(face);
             }
         }
 
+        /**
+         * Checks if the file path has a .ply extension.
+         */
+        bool is_ply() const {
+            const std::string extension = ".ply";
+            return file_path.size() >= extension.size()
+                && file_path.compare(file_path.size() - extension.size(), extension.size(), extension) == 0;
+        }
+
         /**
          * @brief Parses a line from a file containing vertex, texture, normal, or face data and
          * adds the parsed data to the respective lists.
@@ -249,6 +322,7 @@ class object : public hittable {
          * @throws Ends the program if the file cannot be opened
          */
         void readObj() {
+            TRACE_SCOPE("readObj");
             std::ifstream file(file_path);
             if (file.is_open()) {
                 std::string line;
@@ -0,0 +1,42 @@
+/**
+ * @file
+ * @brief Contains the onb class, an orthonormal basis around a direction
+ */
+#ifndef ONB_H
+#define ONB_H
+
+#include <cmath>
+
+#include "../util/rtweekend.h"
+
+/**
+ * @class onb
+ * @brief An orthonormal basis whose w axis is a given unit vector.
+ *
+ * Directions sampled around the z axis are moved around w with local. The tangents are built
+ * without branches (Duff et al., "Building an Orthonormal Basis, Revisited"), so the basis is
+ * continuous everywhere except at w = -z and costs a handful of multiplications.
+ *
+ * @param n The unit vector that becomes the w axis.
+ */
+class onb {
+  public:
+    onb(const vec3& n) : w(n) {
+        double sign = std::copysign(1.0, n.z());
+        double a = -1.0 / (sign + n.z());
+        double b = n.x() * n.y() * a;
+        u = vec3(1.0 + sign * n.x() * n.x() * a, sign * b, -sign * n.x());
+        v = vec3(b, sign + n.y() * n.y() * a, -n.y());
+    }
+
+    /**
+     * @return the direction whose coordinates in this basis are x, y, z
+     */
+    vec3 local(double x, double y, double z) const { return x * u + y * v + z * w; }
+
+    vec3 local(const vec3& a) const { return local(a.x(), a.y(), a.z()); }
+
+    vec3 u, v, w;
+};
+
+#endif
@@ -0,0 +1,436 @@
+/**
+ * @file ply_reader.h
+ * @brief Contains the ply_reader class, which reads binary .ply meshes into the same vertex,
+ * normal and face lists used by the object class
+ */
+#ifndef PLY_READER_H
+#define PLY_READER_H
+
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "vec3.h"
+#include "face_data.h"
+#include "../util/trace.h"
+
+/**
+ * @class mapped_file
+ * @brief Read-only memory mapping of a whole file, unmapped on destruction.
+ */
+class mapped_file {
+  public:
+    mapped_file(const std::string& path) {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) return;
+
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_size > 0) {
+            void* ptr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (ptr != MAP_FAILED) {
+                bytes = static_cast<const unsigned char*>(ptr);
+                length = static_cast<size_t>(st.st_size);
+                madvise(ptr, length, MADV_SEQUENTIAL);
+            }
+        }
+        close(fd);
+    }
+
+    ~mapped_file() {
+        if (bytes) munmap(const_cast<unsigned char*>(bytes), length);
+    }
+
+    mapped_file(const mapped_file&) = delete;
+    mapped_file& operator=(const mapped_file&) = delete;
+
+    bool is_open() const { return bytes != nullptr; }
+    const unsigned char* data() const { return bytes; }
+    size_t size() const { return length; }
+
+  private:
+    const unsigned char* bytes = nullptr;
+    size_t length = 0;
+};
+
+/**
+ * @class ply_reader
+ * @brief Reads binary (little or big endian) .ply files.
+ *
+ * The file is memory mapped and the vertex and face elements are decoded straight from the
+ * mapping, without going through a text stream. When the vertex element is stored as native
+ * endian doubles laid out exactly like point3 (x, y, z), the whole block is copied into the
+ * vertex list at once. Faces with more than three vertices are triangulated as fans.
+ *
+ * Normals are read from the nx, ny and nz properties when present, otherwise they are computed
+ * per vertex from the area weighted face normals. Normal indices of the faces always match
+ * their vertex indices.
+ *
+ * @param file_path The path of the .ply file
+ */
+class ply_reader {
+  public:
+    ply_reader(std::string _file_path) : file_path(_file_path) {}
+
+    /**
+     * @brief Reads the file and appends its data to the given lists.
+     *
+     * @param vertice_list the list that receives the vertices
+     * @param normal_list the list that receives the vertex normals
+     * @param face_list the list that receives the triangles
+     *
+     * @throws Ends the program if the file cannot be opened or is not a supported .ply file
+     */
+    void read(std::vector<point3>& vertice_list, std::vector<vec3>& normal_list, std::vector<face_data>& face_list) {
+        TRACE_SCOPE("ply_reader::read");
+        mapped_file file(file_path);
+        if (!file.is_open())
+            fail("Failure opening ply file");
+
+        const unsigned char* cursor = file.data() + parse_header(file);
+        const unsigned char* end = file.data() + file.size();
+
+        size_t first_vertex = vertice_list.size();
+        bool has_normals = false;
+
+        for (const auto& element : elements) {
+            // Every record takes at least its scalars and list counts, so larger counts cannot fit
+            long least = min_record_size(element);
+            if (least > 0 && element.count > (end - cursor) / least) fail("Truncated ply file");
+
+            if (element.name == "vertex") {
+                cursor = read_vertices(element, cursor, end, vertice_list, normal_list, has_normals);
+            } else if (element.name == "face") {
+                cursor = read_faces(element, cursor, end, first_vertex, vertice_list.size(), face_list);
+            } else {
+                for (long k = 0; k < element.count; k++)
+                    cursor = skip_record(element, cursor, end);
+            }
+        }
+
+        if (!has_normals)
+            compute_normals(vertice_list, normal_list, face_list, first_vertex);
+    }
+
+  private:
+    enum scalar_type { ply_int8, ply_uint8, ply_int16, ply_uint16, ply_int32, ply_uint32, ply_float32, ply_float64 };
+
+    struct property {
+        std::string name;
+        scalar_type type = ply_float32;
+        bool is_list = false;
+        scalar_type count_type = ply_uint8; // Only read for lists
+    };
+
+    struct element {
+        std::string name;
+        long count;
+        std::vector<property> properties;
+    };
+
+    std::string file_path;
+    std::vector<element> elements;
+    bool swap_bytes = false;
+
+    [[noreturn]] void fail(const std::string& message) const {
+        std::cerr << "Error: " << message << ": " << file_path << std::endl;
+        exit(1);
+    }
+
+    static int type_size(scalar_type type) {
+        switch (type) {
+            case ply_int8: case ply_uint8:   return 1;
+            case ply_int16: case ply_uint16: return 2;
+            case ply_int32: case ply_uint32: case ply_float32: return 4;
+            default: return 8;
+        }
+    }
+
+    scalar_type parse_type(const std::string& name) const {
+        if (name == "char"   || name == "int8")    return ply_int8;
+        if (name == "uchar"  || name == "uint8")   return ply_uint8;
+        if (name == "short"  || name == "int16")   return ply_int16;
+        if (name == "ushort" || name == "uint16")  return ply_uint16;
+        if (name == "int"    || name == "int32")   return ply_int32;
+        if (name == "uint"   || name == "uint32")  return ply_uint32;
+        if (name == "float"  || name == "float32") return ply_float32;
+        if (name == "double" || name == "float64") return ply_float64;
+        fail("Unknown ply property type '" + name + "'");
+    }
+
+    static bool host_is_little_endian() {
+        const uint16_t probe = 1;
+        return *reinterpret_cast<const unsigned char*>(&probe) == 1;
+    }
+
+    /**
+     * @brief Parses the ascii header and returns the offset of the binary body
+     */
+    size_t parse_header(const mapped_file& file) {
+        const char* text = reinterpret_cast<const char*>(file.data());
+        const char* header_end = nullptr;
+        for (size_t i = 0; i + 10 <= file.size(); i++) {
+            if (std::memcmp(text + i, "end_header", 10) == 0) {
+                header_end = text + i + 10;
+                break;
+            }
+        }
+        if (file.size() < 3 || header_end == nullptr || std::memcmp(text, "ply", 3) != 0)
+            fail("Invalid ply header");
+
+        // The body starts right after the line break following end_header, if the file goes on
+        const char* text_end = text + file.size();
+        if (header_end < text_end && *header_end == '\r') header_end++;
+        if (header_end < text_end && *header_end == '\n') header_end++;
+
+        std::istringstream header(std::string(text, header_end));
+        std::string line;
+        while (std::getline(header, line)) {
+            std::istringstream iss(line);
+            std::string keyword;
+            iss >> keyword;
+
+            if (keyword == "format") {
+                std::string format;
+                iss >> format;
+                if (format == "binary_little_endian")
+                    swap_bytes = !host_is_little_endian();
+                else if (format == "binary_big_endian")
+                    swap_bytes = host_is_little_endian();
+                else
+                    fail("Only binary ply files are supported");
+            } else if (keyword == "element") {
+                element e;
+                if (!(iss >> e.name >> e.count) || e.count < 0) fail("Invalid ply element count");
+                elements.push_back(e);
+            } else if (keyword == "property") {
+                if (elements.empty()) fail("Ply property declared outside of an element");
+                property p;
+                std::string type;
+                iss >> type;
+                if (type == "list") {
+                    std::string count_type, item_type;
+                    iss >> count_type >> item_type >> p.name;
+                    p.is_list = true;
+                    p.count_type = parse_type(count_type);
+                    p.type = parse_type(item_type);
+                } else {
+                    iss >> p.name;
+                    p.type = parse_type(type);
+                }
+                elements.back().properties.push_back(p);
+            }
+        }
+
+        return header_end - text;
+    }
+
+    /**
+     * @brief Reads one scalar of the given type at ptr, converting it to double
+     */
+    double read_scalar(const unsigned char* ptr, scalar_type type) const {
+        unsigned char raw[8];
+        int size = type_size(type);
+        for (int b = 0; b < size; b++)
+            raw[b] = swap_bytes ? ptr[size - 1 - b] : ptr[b];
+
+        switch (type) {
+            case ply_int8:    { int8_t v;   std::memcpy(&v, raw, 1); return v; }
+            case ply_uint8:   { uint8_t v;  std::memcpy(&v, raw, 1); return v; }
+            case ply_int16:   { int16_t v;  std::memcpy(&v, raw, 2); return v; }
+            case ply_uint16:  { uint16_t v; std::memcpy(&v, raw, 2); return v; }
+            case ply_int32:   { int32_t v;  std::memcpy(&v, raw, 4); return v; }
+            case ply_uint32:  { uint32_t v; std::memcpy(&v, raw, 4); return v; }
+            case ply_float32: { float v;    std::memcpy(&v, raw, 4); return v; }
+            default:          { double v;   std::memcpy(&v, raw, 8); return v; }
+        }
+    }
+
+    /**
+     * @brief The bytes of a record of e whose lists are all empty
+     */
+    static long min_record_size(const element& e) {
+        long size = 0;
+        for (const auto& p : e.properties)
+            size += type_size(p.is_list ? p.count_type : p.type);
+        return size;
+    }
+
+    /**
+     * @brief Reads the length of a list at cursor, failing unless that many items fit before end
+     */
+    long read_list_length(const property& p, const unsigned char*& cursor, const unsigned char* end) const {
+        long n = static_cast<long>(read_scalar(cursor, p.count_type));
+        cursor += type_size(p.count_type);
+        if (n < 0) fail("Negative ply list length");
+        if (n > (end - cursor) / type_size(p.type)) fail("Truncated ply file");
+        return n;
+    }
+
+    const unsigned char* skip_record(const element& e, const unsigned char* cursor, const unsigned char* end) const {
+        for (const auto& p : e.properties) {
+            if (cursor + type_size(p.is_list ? p.count_type : p.type) > end) fail("Truncated ply file");
+            if (p.is_list) {
+                long n = read_list_length(p, cursor, end);
+                cursor += n * type_size(p.type);
+            } else {
+                cursor += type_size(p.type);
+            }
+        }
+        return cursor;
+    }
+
+    const unsigned char* read_vertices(
+        const element& e, const unsigned char* cursor, const unsigned char* end,
+        std::vector<point3>& vertice_list, std::vector<vec3>& normal_list, bool& has_normals
+    ) const {
+        int x = -1, y = -1, z = -1, nx = -1, ny = -1, nz = -1;
+        std::vector<int> offsets;
+        int stride = 0;
+        bool fixed_size = true;
+
+        for (int k = 0; k < static_cast<int>(e.properties.size()); k++) {
+            const property& p = e.properties[k];
+            if (p.is_list) { fixed_size = false; break; }
+            offsets.push_back(stride);
+            stride += type_size(p.type);
+
+            if (p.name == "x") x = k;
+            else if (p.name == "y") y = k;
+            else if (p.name == "z") z = k;
+            else if (p.name == "nx") nx = k;
+            else if (p.name == "ny") ny = k;
+            else if (p.name == "nz") nz = k;
+        }
+
+        if (!fixed_size) fail("List properties on ply vertices are not supported");
+        if (x < 0 || y < 0 || z < 0) fail("Ply vertices without x, y and z");
+        if (e.count > (end - cursor) / stride) fail("Truncated ply file");
+
+        has_normals = nx >= 0 && ny >= 0 && nz >= 0;
+
+        // Same layout as point3: copy the mapped block at once. The header has any length, so the
+        // block may not be aligned for doubles and is copied bytewise
+        bool same_layout = !swap_bytes && stride == sizeof(point3) && x == 0 && y == 1 && z == 2
+            && e.properties[0].type == ply_float64 && e.properties[1].type == ply_float64
+            && e.properties[2].type == ply_float64;
+
+        if (same_layout) {
+            static_assert(std::is_trivially_copyable<point3>::value, "point3 must be copyable as bytes");
+            size_t first = vertice_list.size();
+            vertice_list.resize(first + e.count);
+            std::memcpy(vertice_list.data() + first, cursor, static_cast<size_t>(stride) * e.count);
+            return cursor + static_cast<size_t>(stride) * e.count;
+        }
+
+        vertice_list.reserve(vertice_list.size() + e.count);
+        if (has_normals) normal_list.reserve(normal_list.size() + e.count);
+
+        for (long k = 0; k < e.count; k++, cursor += stride) {
+            vertice_list.push_back(point3(
+                read_scalar(cursor + offsets[x], e.properties[x].type),
+                read_scalar(cursor + offsets[y], e.properties[y].type),
+                read_scalar(cursor + offsets[z], e.properties[z].type)
+            ));
+            if (has_normals) {
+                normal_list.push_back(vec3(
+                    read_scalar(cursor + offsets[nx], e.properties[nx].type),
+                    read_scalar(cursor + offsets[ny], e.properties[ny].type),
+                    read_scalar(cursor + offsets[nz], e.properties[nz].type)
+                ));
+            }
+        }
+
+        return cursor;
+    }
+
+    const unsigned char* read_faces(
+        const element& e, const unsigned char* cursor, const unsigned char* end,
+        size_t first_vertex, size_t vertex_count, std::vector<face_data>& face_list
+    ) const {
+        int indices = -1;
+        for (int k = 0; k < static_cast<int>(e.properties.size()); k++) {
+            const property& p = e.properties[k];
+            if (p.is_list && (p.name == "vertex_indices" || p.name == "vertex_index"))
+                indices = k;
+        }
+        if (indices < 0) fail("Ply faces without vertex_indices");
+
+        face_list.reserve(face_list.size() + e.count);
+        const int index_size = type_size(e.properties[indices].type);
+        std::vector<int> polygon;
+
+        for (long k = 0; k < e.count; k++) {
+            for (int p = 0; p < static_cast<int>(e.properties.size()); p++) {
+                const property& prop = e.properties[p];
+                if (cursor + type_size(prop.is_list ? prop.count_type : prop.type) > end) fail("Truncated ply file");
+
+                if (!prop.is_list) {
+                    cursor += type_size(prop.type);
+                    continue;
+                }
+
+                long n = read_list_length(prop, cursor, end);
+
+                if (p != indices) {
+                    cursor += n * type_size(prop.type);
+                    continue;
+                }
+
+                polygon.clear();
+                for (long v = 0; v < n; v++, cursor += index_size) {
+                    long index = static_cast<long>(read_scalar(cursor, prop.type));
+                    if (index < 0 || first_vertex + index >= vertex_count) fail("Ply index out of bounds");
+                    polygon.push_back(static_cast<int>(first_vertex + index));
+                }
+
+                // Triangle fan around the first vertex
+                for (long v = 1; v + 1 < n; v++) {
+                    face_data face;
+                    face.A_index = face.nA_index = polygon[0];
+                    face.B_index = face.nB_index = polygon[v];
+                    face.C_index = face.nC_index = polygon[v + 1];
+                    face_list.push_back(face);
+                }
+            }
+        }
+
+        return cursor;
+    }
+
+    /**
+     * @brief Computes area weighted vertex normals for meshes that do not store them
+     */
+    static void compute_normals(
+        const std::vector<point3>& vertice_list, std::vector<vec3>& normal_list,
+        const std::vector<face_data>& face_list, size_t first_vertex
+    ) {
+        normal_list.resize(vertice_list.size());
+        for (size_t k = first_vertex; k < vertice_list.size(); k++)
+            normal_list[k] = vec3(0, 0, 0);
+
+        for (const auto& face : face_list) {
+            if (face.A_index < static_cast<int>(first_vertex)) continue;
+            vec3 n = cross(vertice_list[face.B_index] - vertice_list[face.A_index],
+                           vertice_list[face.C_index] - vertice_list[face.A_index]);
+            normal_list[face.A_index] += n;
+            normal_list[face.B_index] += n;
+            normal_list[face.C_index] += n;
+        }
+
+        for (size_t k = first_vertex; k < vertice_list.size(); k++) {
+            if (!normal_list[k].near_zero())
+                normal_list[k] = unit_vector(normal_list[k]);
+        }
+    }
+};
+
+#endif
@@ -5,22 +5,52 @@
 #ifndef RAY_H
 #define RAY_H
 
+#include <cstdint>
+
 #include "vec3.h"
 
+/**
+ * @brief What a ray is traced for, one bit each so they can be combined into visibility masks
+ */
+enum ray_kind : uint8_t {
+    ray_camera    = 1, // From the camera through a pixel
+    ray_secondary = 2, // Scattered by a surface
+    ray_shadow    = 4, // Toward a light sample
+};
+
+const uint8_t visible_to_all = ray_camera | ray_secondary | ray_shadow;
+
+/**
+ * @brief Options that change how a ray is intersected, combined with |
+ */
+enum ray_flag : uint8_t {
+    ray_cull_back_faces        = 1, // Surfaces facing away from the ray are not hit
+    ray_opaque_only            = 2, // Objects that are not opaque are not hit
+    ray_terminate_on_first_hit = 4, // Lists stop at the first hit found instead of the closest
+};
+
 /**
  * @class ray
  * @brief Represents a ray
  *
  * The class represents a ray using a point of origin and a direction vector and provides a method to calculate the coordinates of a point on the ray given a t
+ *
+ * It also carries its kind, which objects match against their visibility masks, and its flags.
+ * Rays are secondary rays without flags unless told otherwise.
  */
 class ray {
   public:
     ray() {}
 
-    ray(const point3& origin, const vec3& direction) : orig(origin), dir(direction) {}
+    ray(const point3& origin, const vec3& direction, ray_kind kind = ray_secondary, uint8_t flags = 0)
+      : orig(origin), dir(direction), kind_(kind), flags_(flags) {}
 
     point3 origin() const  { return orig; }
     vec3 direction() const { return dir; }
+    ray_kind kind() const  { return kind_; }
+    uint8_t flags() const  { return flags_; }
+
+    bool has_flag(ray_flag flag) const { return (flags_ & flag) != 0; }
 
     point3 at(double t) const {
         return orig + t*dir;
@@ -29,6 +59,8 @@ class ray {
   private:
     point3 orig;
     vec3 dir;
+    ray_kind kind_ = ray_secondary;
+    uint8_t flags_ = 0;
 };
 
-#endif
\ No newline at end of file
+#endif
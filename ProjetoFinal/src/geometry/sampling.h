@@ -0,0 +1,105 @@
+/**
+ * @file
+ * @brief Contains closed form direction samplers, which turn two uniform numbers into a direction
+ *
+ * Every sampler consumes exactly two numbers in [0,1) and has no loops or rejections, so it maps
+ * the stratification of low discrepancy samples straight onto the directions and costs the same
+ * for every sample. Hemisphere and lobe directions are returned around the z axis; an onb moves
+ * them around a normal.
+ *
+ * The angles around the axis go through sin_2pi and cos_2pi, which are polynomials. The batch
+ * versions work on arrays of numbers and write one array per coordinate; their loops have no
+ * branches, so the compiler can vectorize them for shading many hits at once.
+ */
+#ifndef SAMPLING_H
+#define SAMPLING_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+
+#include "../util/rtweekend.h"
+
+/**
+ * @return a direction uniformly distributed over the unit sphere
+ */
+inline vec3 uniform_sphere(double u1, double u2) {
+    double z = 1 - 2 * u1;
+    double r = std::sqrt(std::max(0.0, 1 - z * z));
+    return vec3(r * cos_2pi(u2), r * sin_2pi(u2), z);
+}
+
+/**
+ * @return a direction of the z > 0 hemisphere, with a density proportional to its z (the cosine of
+ * its angle to the axis), which matches the light a Lambertian surface reflects
+ *
+ * A uniform point of the unit disk (Malley's method) is lifted onto the hemisphere.
+ */
+inline vec3 cosine_hemisphere(double u1, double u2) {
+    double r = std::sqrt(u1);
+    return vec3(r * cos_2pi(u2), r * sin_2pi(u2), std::sqrt(std::max(0.0, 1 - u1)));
+}
+
+/**
+ * @return a microfacet normal around the z axis, distributed by the GGX (Trowbridge-Reitz)
+ * distribution of the given roughness
+ *
+ * @param alpha the roughness, 0 for a mirror
+ */
+inline vec3 ggx_normal(double u1, double u2, double alpha) {
+    double cos_theta = std::sqrt((1 - u1) / (1 + (alpha * alpha - 1) * u1));
+    double sin_theta = std::sqrt(std::max(0.0, 1 - cos_theta * cos_theta));
+    return vec3(sin_theta * cos_2pi(u2), sin_theta * sin_2pi(u2), cos_theta);
+}
+
+/**
+ * @return a direction uniformly distributed over the cone around the z axis whose half angle has
+ * the cosine cos_theta_max, the directions in which a sphere is seen
+ */
+inline vec3 uniform_cone(double u1, double u2, double cos_theta_max) {
+    double z = 1 + u1 * (cos_theta_max - 1);
+    double r = std::sqrt(std::max(0.0, 1 - z * z));
+    return vec3(r * cos_2pi(u2), r * sin_2pi(u2), z);
+}
+
+/**
+ * @brief uniform_sphere for count pairs of numbers
+ */
+inline void uniform_sphere_batch(size_t count, const double* u1, const double* u2, double* x, double* y, double* z) {
+    for (size_t k = 0; k < count; k++) {
+        double cz = 1 - 2 * u1[k];
+        double r = std::sqrt(std::max(0.0, 1 - cz * cz));
+        x[k] = r * cos_2pi(u2[k]);
+        y[k] = r * sin_2pi(u2[k]);
+        z[k] = cz;
+    }
+}
+
+/**
+ * @brief cosine_hemisphere for count pairs of numbers
+ */
+inline void cosine_hemisphere_batch(size_t count, const double* u1, const double* u2, double* x, double* y, double* z) {
+    for (size_t k = 0; k < count; k++) {
+        double r = std::sqrt(u1[k]);
+        x[k] = r * cos_2pi(u2[k]);
+        y[k] = r * sin_2pi(u2[k]);
+        z[k] = std::sqrt(std::max(0.0, 1 - u1[k]));
+    }
+}
+
+/**
+ * @brief ggx_normal for count pairs of numbers, all with the same roughness
+ */
+inline void ggx_normal_batch(size_t count, const double* u1, const double* u2, double alpha,
+                             double* x, double* y, double* z) {
+    const double alpha2 = alpha * alpha;
+    for (size_t k = 0; k < count; k++) {
+        double cos_theta = std::sqrt((1 - u1[k]) / (1 + (alpha2 - 1) * u1[k]));
+        double sin_theta = std::sqrt(std::max(0.0, 1 - cos_theta * cos_theta));
+        x[k] = sin_theta * cos_2pi(u2[k]);
+        y[k] = sin_theta * sin_2pi(u2[k]);
+        z[k] = cos_theta;
+    }
+}
+
+#endif
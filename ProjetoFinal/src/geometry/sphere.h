@@ -8,7 +8,10 @@
 #include "hittable.h"
 #include "vec3.h"
 #include "material.h"
+#include "onb.h"
+#include "sampling.h"
 #include "../util/interval.h"
+#include "../util/render_stats.h"
 
 /**
  * @class sphere
@@ -19,6 +22,11 @@
  *
  * @param center The center point of the sphere.
  * @param radius The radius of the sphere.
+ *
+ * With back faces culled only the near intersection counts, so rays starting inside miss it.
+ *
+ * As a light, it is sampled uniformly over the cone of directions it covers seen from the shaded
+ * point, so every sample reaches it. Points inside the sphere are not sampled.
  */
 class sphere : public hittable {
   public:
@@ -30,6 +38,8 @@ class sphere : public hittable {
     }
 
     bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
+        render_stats::count_test();
+
         vec3 oc = r.origin() - center;
         auto a = r.direction().length_squared();
         auto half_b = dot(oc, r.direction());
@@ -42,6 +52,7 @@ class sphere : public hittable {
         // Find the nearest root that lies in the acceptable range.
         auto root = (-half_b - sqrtd) / a;
         if (!ray_t.surrounds(root)) {
+            if (r.has_flag(ray_cull_back_faces)) return false;
             root = (-half_b + sqrtd) / a;
             if (!ray_t.surrounds(root))
                 return false;
@@ -53,9 +64,53 @@ class sphere : public hittable {
         rec.set_face_normal(r, outward_normal);
         rec.mat = mat;
 
+        render_stats::count_hit();
+        return true;
+    }
+
+    bool occluded(const ray& r, interval ray_t) const override {
+        render_stats::count_test();
+
+        vec3 oc = r.origin() - center;
+        auto a = r.direction().length_squared();
+        auto half_b = dot(oc, r.direction());
+        auto c = oc.length_squared() - radius*radius;
+
+        auto discriminant = half_b*half_b - a*c;
+        if (discriminant < 0) return false;
+        auto sqrtd = sqrt(discriminant);
+
+        // Either root will do, unless the far one faces away
+        if (!ray_t.surrounds((-half_b - sqrtd) / a)
+            && (r.has_flag(ray_cull_back_faces) || !ray_t.surrounds((-half_b + sqrtd) / a)))
+            return false;
+
+        render_stats::count_hit();
         return true;
     }
 
+    double pdf_value(const point3& origin, const vec3& direction) const override {
+        if (!this->occluded(ray(origin, direction), interval(0.001, infinity)))
+            return 0.0;
+
+        double sin2_theta_max = radius*radius / (center - origin).length_squared();
+        if (sin2_theta_max >= 1) return 0.0;
+
+        // 1 - cos written so that far, small spheres keep their precision
+        double solid_angle = 2*pi * sin2_theta_max / (1 + sqrt(1 - sin2_theta_max));
+        return 1 / solid_angle;
+    }
+
+    vec3 random(const point3& origin, sampler& s) const override {
+        vec3 direction = center - origin;
+        double sin2_theta_max = radius*radius / direction.length_squared();
+        sample_2d p = s.get_2d();
+        if (sin2_theta_max >= 1) return uniform_sphere(p.u, p.v);
+
+        double cos_theta_max = sqrt(1 - sin2_theta_max);
+        return onb(unit_vector(direction)).local(uniform_cone(p.u, p.v, cos_theta_max));
+    }
+
   private:
     point3 center;
     double radius;
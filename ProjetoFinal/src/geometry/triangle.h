@@ -9,6 +9,7 @@
 #include "hittable.h"
 #include "mat3.h"
 #include "../util/interval.h"
+#include "../util/render_stats.h"
 #include "material.h"
 
 /**
@@ -18,6 +19,11 @@
  * This class encapsulates the properties of a triangle, including its vertices and normals at each 
  * vertex. It inherits from the hittable class, allowing it to be used to detect intersections with rays.
  *
+ * Its front is the side its vertex normals point to, whatever the order of the vertices, which is
+ * the side rays culling back faces hit.
+ *
+ * As a light, points are drawn uniformly over its area.
+ *
  * @param points A mat3 containing the coordinates of the triangle's vertices.
  * @param normals A mat3 containing the normal vectors at each of the triangle's vertices.
  */
@@ -27,62 +33,115 @@ class triangle : public hittable {
             points(_points), normals(_normals), mat(_material) {}
 
         bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
-            vec3 positionVector = points[0] - r.origin();
+            render_stats::count_test();
+
+            double u, v, w; // barycentric values
+            if (!intersect(r, ray_t, rec.t, u, v)) return false;
+            w = 1 - u - v;
+            rec.p = r.at(rec.t);
+
+            // Calculate the normal at the intersection point using barycentric coordinates
+            vec3 outward_normal = u * normals[0] + v * normals[1] + w * normals[2];
+            outward_normal = unit_vector(outward_normal);
+
+            rec.set_face_normal(r, outward_normal);
+            rec.mat = mat;
+            render_stats::count_hit();
+            return true;
+        }
+
+        bool occluded(const ray& r, interval ray_t) const override {
+            render_stats::count_test();
+
+            double t, u, v;
+            if (!intersect(r, ray_t, t, u, v)) return false;
+
+            render_stats::count_hit();
+            return true;
+        }
+
+        double pdf_value(const point3& origin, const vec3& direction) const override {
+            render_stats::count_test();
+            double t, u, v;
+            if (!intersect(ray(origin, direction), interval(0.001, infinity), t, u, v))
+                return 0.0;
+            render_stats::count_hit();
+
+            // Density per area turned into density per solid angle
+            double distance_squared = t * t * direction.length_squared();
+            double cosine = fabs(dot(direction, plane_normal)) / (direction.length() * plane_normal.length());
+            if (cosine < kEpsilon) return 0.0;
+
+            return distance_squared / (cosine * area());
+        }
+
+        vec3 random(const point3& origin, sampler& s) const override {
+            sample_2d p = s.get_2d();
+            double root = sqrt(p.u);
+            point3 target = (1 - root) * points[0] + root * (1 - p.v) * points[1] + root * p.v * points[2];
+            return target - origin;
+        }
+
+        double area() const {
+            return 0.5 * plane_normal.length();
+        }
+
+    private:
+        mat3 points;
+        mat3 normals;
+        shared_ptr<material> mat;
+
+        vec3 AB = points[1] - points[0]; 
+        vec3 BC = points[2] - points[1]; 
+        vec3 CA = points[0] - points[2]; 
+        vec3 plane_normal = cross(AB, BC);
+        double denom = dot(plane_normal, plane_normal);
+        double D = dot(-plane_normal, points[0]);
+        double front_sign = dot(plane_normal, normals[0] + normals[1] + normals[2]) < 0 ? -1 : 1;
 
+        /**
+         * Intersects r with the triangle.
+         *
+         * @param t set to the ray parameter of the intersection
+         * @param u set to the barycentric weight of the first vertex
+         * @param v set to the barycentric weight of the second vertex
+         * @return whether r crosses the triangle within ray_t
+         */
+        bool intersect(const ray& r, interval ray_t, double& t, double& u, double& v) const {
             double nDotDirection = dot(plane_normal, r.direction()); 
 
             if (fabs(nDotDirection) < kEpsilon) { // Ray is parallel to the plane and therefore a miss
                 return false;
             }
+            if (r.has_flag(ray_cull_back_faces) && front_sign * nDotDirection > 0) return false; // Back face
 
-            rec.t = -(dot(plane_normal, r.origin()) + D) / nDotDirection; //figure out t for intersection of ray with plane
-            if (!ray_t.surrounds(rec.t)) return false; // Out of the interval
-            if (rec.t < 0) return false; // Plane behind ray and therefore a miss
+            t = -(dot(plane_normal, r.origin()) + D) / nDotDirection; //figure out t for intersection of ray with plane
+            if (!ray_t.surrounds(t)) return false; // Out of the interval
+            if (t < 0) return false; // Plane behind ray and therefore a miss
 
             // Inside-outside test
-            rec.p = r.at(rec.t);
+            point3 p = r.at(t);
             
             vec3 C; // vector perpendicular to triangle's plane
-            double u, v, w; // barycentric values
             
-            vec3 AH = rec.p - points[0];
+            vec3 AH = p - points[0];
             C = cross(AB, AH);
             if (dot(plane_normal, C) < 0) return false; // P is on the right side
 
-            vec3 BH = rec.p - points[1];
+            vec3 BH = p - points[1];
             C = cross(BC, BH);
             u = dot(plane_normal, C);
             if (u < 0) return false; // P is on the right side
 
-            vec3 CH = rec.p - points[2];
+            vec3 CH = p - points[2];
             C = cross(CA, CH);
             v = dot(plane_normal, C);
             if (v < 0) return false; // P is on the right side
 
             u /= denom;
             v /= denom;
-            w = 1 - u - v;
-
-            // Calculate the normal at the intersection point using barycentric coordinates
-            vec3 outward_normal = u * normals[0] + v * normals[1] + w * normals[2];
-            outward_normal = unit_vector(outward_normal);
-
-            rec.set_face_normal(r, outward_normal);
-            rec.mat = mat;
             return true;
         }
-
-    private:
-        mat3 points;
-        mat3 normals;
-        shared_ptr<material> mat;
-
-        vec3 AB = points[1] - points[0]; 
-        vec3 BC = points[2] - points[1]; 
-        vec3 CA = points[0] - points[2]; 
-        vec3 plane_normal = cross(AB, BC);
-        double denom = dot(plane_normal, plane_normal);
-        double D = dot(-plane_normal, points[0]);
 };
 
 #endif
\ No newline at end of file
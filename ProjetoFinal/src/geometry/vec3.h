@@ -130,16 +130,17 @@ inline vec3 unit_vector(vec3 v) {
     return v / v.length();
 }
 
-inline vec3 random_in_unit_sphere() {
-    while (true) {
-        auto p = vec3::random(-1,1);
-        if (p.length_squared() < 1)
-            return p;
-    }
+inline vec3 random_unit_vector() {
+    // Uniform on the sphere in closed form: uniform height, uniform angle around the axis
+    auto z = 1 - 2*random_double();
+    auto r = sqrt(fmax(0.0, 1 - z*z));
+    auto t = random_double();
+    return vec3(r*cos_2pi(t), r*sin_2pi(t), z);
 }
 
-inline vec3 random_unit_vector() {
-    return unit_vector(random_in_unit_sphere());
+inline vec3 random_in_unit_sphere() {
+    // A uniform direction at a radius whose cube is uniform
+    return cbrt(random_double()) * random_unit_vector();
 }
 
 inline vec3 random_on_hemisphere(const vec3& normal) {
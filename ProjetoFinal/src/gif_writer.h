@@ -0,0 +1,367 @@
+/**
+ * @file gif_writer.h
+ * @brief Contains the gif_writer class, which encodes frames into an animated GIF as they are rendered
+ */
+#ifndef GIF_WRITER_H
+#define GIF_WRITER_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "framebuffer.h"
+
+/**
+ * @class gif_palette
+ * @brief A 256 color palette built with k-means and a vectorized nearest color search.
+ *
+ * The colors are kept as planar float arrays so four palette entries are compared per SSE2
+ * instruction.
+ */
+class gif_palette {
+  public:
+    static const int size = 256;
+
+    gif_palette() {
+        std::fill(red, red + size, 0.0f);
+        std::fill(green, green + size, 0.0f);
+        std::fill(blue, blue + size, 0.0f);
+    }
+
+    /**
+     * @brief Builds the palette from a sampled subset of a frame's pixels.
+     *
+     * Up to `max_samples` evenly spaced pixels are clustered with a few k-means iterations,
+     * starting from evenly spaced samples, so the result is deterministic.
+     *
+     * @param image the frame used to build the palette
+     * @param max_samples the maximum number of pixels taken into account
+     * @param iterations the number of k-means iterations
+     */
+    void build(const framebuffer& image, size_t max_samples = 16384, int iterations = 8) {
+        const size_t pixels = static_cast<size_t>(image.get_width()) * image.get_height();
+        const size_t step = std::max<size_t>(1, pixels / max_samples);
+        const unsigned char* bytes = image.data();
+
+        std::vector<float> samples;
+        for (size_t k = 0; k < pixels; k += step) {
+            samples.push_back(bytes[k * 3]);
+            samples.push_back(bytes[k * 3 + 1]);
+            samples.push_back(bytes[k * 3 + 2]);
+        }
+        const size_t count = samples.size() / 3;
+        if (count == 0) return;
+
+        for (int c = 0; c < size; c++) {
+            size_t s = (c * count) / size;
+            red[c] = samples[s * 3];
+            green[c] = samples[s * 3 + 1];
+            blue[c] = samples[s * 3 + 2];
+        }
+
+        std::vector<double> sums(size * 3);
+        std::vector<size_t> members(size);
+        for (int iteration = 0; iteration < iterations; iteration++) {
+            std::fill(sums.begin(), sums.end(), 0.0);
+            std::fill(members.begin(), members.end(), 0);
+
+            for (size_t s = 0; s < count; s++) {
+                int c = nearest(samples[s * 3], samples[s * 3 + 1], samples[s * 3 + 2]);
+                sums[c * 3] += samples[s * 3];
+                sums[c * 3 + 1] += samples[s * 3 + 1];
+                sums[c * 3 + 2] += samples[s * 3 + 2];
+                members[c]++;
+            }
+
+            // Empty clusters keep their previous color
+            for (int c = 0; c < size; c++) {
+                if (members[c] == 0) continue;
+                red[c] = static_cast<float>(sums[c * 3] / members[c]);
+                green[c] = static_cast<float>(sums[c * 3 + 1] / members[c]);
+                blue[c] = static_cast<float>(sums[c * 3 + 2] / members[c]);
+            }
+        }
+    }
+
+    /**
+     * @return the index of the palette color closest to r, g, b
+     */
+    int nearest(float r, float g, float b) const {
+#ifdef __SSE2__
+        const __m128 pr = _mm_set1_ps(r), pg = _mm_set1_ps(g), pb = _mm_set1_ps(b);
+        __m128 best = _mm_set1_ps(1e30f);
+        __m128i best_index = _mm_setzero_si128();
+        __m128i index = _mm_setr_epi32(0, 1, 2, 3);
+        const __m128i four = _mm_set1_epi32(4);
+
+        for (int c = 0; c < size; c += 4) {
+            __m128 dr = _mm_sub_ps(_mm_load_ps(red + c), pr);
+            __m128 dg = _mm_sub_ps(_mm_load_ps(green + c), pg);
+            __m128 db = _mm_sub_ps(_mm_load_ps(blue + c), pb);
+            __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dr, dr), _mm_mul_ps(dg, dg)), _mm_mul_ps(db, db));
+
+            __m128i closer = _mm_castps_si128(_mm_cmplt_ps(distance, best));
+            best = _mm_min_ps(distance, best);
+            best_index = _mm_or_si128(_mm_and_si128(closer, index), _mm_andnot_si128(closer, best_index));
+            index = _mm_add_epi32(index, four);
+        }
+
+        alignas(16) float distances[4];
+        alignas(16) int32_t indices[4];
+        _mm_store_ps(distances, best);
+        _mm_store_si128(reinterpret_cast<__m128i*>(indices), best_index);
+
+        int result = indices[0];
+        float result_distance = distances[0];
+        for (int lane = 1; lane < 4; lane++) {
+            if (distances[lane] < result_distance || (distances[lane] == result_distance && indices[lane] < result)) {
+                result_distance = distances[lane];
+                result = indices[lane];
+            }
+        }
+        return result;
+#else
+        int result = 0;
+        float result_distance = 1e30f;
+        for (int c = 0; c < size; c++) {
+            float dr = red[c] - r, dg = green[c] - g, db = blue[c] - b;
+            float distance = dr * dr + dg * dg + db * db;
+            if (distance < result_distance) {
+                result_distance = distance;
+                result = c;
+            }
+        }
+        return result;
+#endif
+    }
+
+    /**
+     * Writes the palette as a GIF color table (256 RGB triplets).
+     */
+    void write_table(std::FILE* out) const {
+        for (int c = 0; c < size; c++) {
+            std::fputc(to_byte(red[c]), out);
+            std::fputc(to_byte(green[c]), out);
+            std::fputc(to_byte(blue[c]), out);
+        }
+    }
+
+  private:
+    alignas(16) float red[size];
+    alignas(16) float green[size];
+    alignas(16) float blue[size];
+
+    static int to_byte(float value) {
+        return static_cast<int>(std::min(255.0f, std::max(0.0f, std::round(value))));
+    }
+};
+
+/**
+ * @class gif_writer
+ * @brief Encodes frames into an animated, looping GIF file as they arrive.
+ *
+ * The palette is built from the first frame and stored as the global color table, so later
+ * frames only need the nearest color mapping and LZW compression.
+ *
+ * @param path The name of the GIF file.
+ * @param frames_per_second The playback rate, converted to per frame delays.
+ */
+class gif_writer {
+  public:
+    gif_writer(std::string path, int _frames_per_second) : frames_per_second(_frames_per_second) {
+        out = std::fopen(path.c_str(), "wb");
+        if (out == nullptr)
+            std::cerr << "Error: Could not open the GIF output: " << path << std::endl;
+    }
+
+    ~gif_writer() { close(); }
+
+    gif_writer(const gif_writer&) = delete;
+    gif_writer& operator=(const gif_writer&) = delete;
+
+    bool is_open() const { return out != nullptr; }
+
+    /**
+     * Appends a frame to the animation.
+     *
+     * @param image the frame, which must keep the size of the first frame
+     */
+    void write_frame(const framebuffer& image) {
+        if (out == nullptr) return;
+
+        if (width == 0) {
+            width = image.get_width();
+            height = image.get_height();
+            palette.build(image);
+            write_header();
+        }
+
+        if (image.get_width() != width || image.get_height() != height) {
+            std::cerr << "Error: GIF frames must all have the same size" << std::endl;
+            return;
+        }
+
+        const size_t pixels = static_cast<size_t>(width) * height;
+        indices.resize(pixels);
+        const unsigned char* bytes = image.data();
+        for (size_t k = 0; k < pixels; k++)
+            indices[k] = static_cast<unsigned char>(palette.nearest(bytes[k * 3], bytes[k * 3 + 1], bytes[k * 3 + 2]));
+
+        // Delays are in hundredths of a second, rounded so they add up to the exact duration
+        int delay = static_cast<int>(std::lround((frame_count + 1) * 100.0 / frames_per_second)
+                                   - std::lround(frame_count * 100.0 / frames_per_second));
+        frame_count++;
+
+        // Graphic control extension
+        const unsigned char control[] = {0x21, 0xF9, 0x04, 0x00,
+            static_cast<unsigned char>(delay & 0xff), static_cast<unsigned char>(delay >> 8), 0x00, 0x00};
+        std::fwrite(control, 1, sizeof(control), out);
+
+        // Image descriptor, full frame using the global color table
+        std::fputc(0x2C, out);
+        put_u16(0);
+        put_u16(0);
+        put_u16(width);
+        put_u16(height);
+        std::fputc(0x00, out);
+
+        write_lzw();
+    }
+
+    /**
+     * Writes the trailer and closes the file.
+     */
+    void close() {
+        if (out == nullptr) return;
+        if (width != 0)
+            std::fputc(0x3B, out);
+        std::fclose(out);
+        out = nullptr;
+    }
+
+  private:
+    std::FILE* out = nullptr;
+    int frames_per_second;
+    int width = 0;
+    int height = 0;
+    int frame_count = 0;
+    gif_palette palette;
+    std::vector<unsigned char> indices;
+
+    // LZW output state
+    std::vector<uint16_t> dictionary;
+    std::vector<unsigned char> block;
+    uint32_t bit_buffer = 0;
+    int bit_count = 0;
+
+    void put_u16(int value) {
+        std::fputc(value & 0xff, out);
+        std::fputc((value >> 8) & 0xff, out);
+    }
+
+    void write_header() {
+        std::fwrite("GIF89a", 1, 6, out);
+        put_u16(width);
+        put_u16(height);
+        std::fputc(0xF7, out); // Global color table of 256 entries, 8 bit color resolution
+        std::fputc(0x00, out); // Background color index
+        std::fputc(0x00, out); // Square pixels
+        palette.write_table(out);
+
+        // Netscape extension, loop forever
+        const unsigned char loop[] = {0x21, 0xFF, 0x0B, 'N', 'E', 'T', 'S', 'C', 'A', 'P', 'E', '2', '.', '0',
+                                      0x03, 0x01, 0x00, 0x00, 0x00};
+        std::fwrite(loop, 1, sizeof(loop), out);
+    }
+
+    void flush_block() {
+        if (block.empty()) return;
+        std::fputc(static_cast<int>(block.size()), out);
+        std::fwrite(block.data(), 1, block.size(), out);
+        block.clear();
+    }
+
+    void write_code(int code, int code_size) {
+        bit_buffer |= static_cast<uint32_t>(code) << bit_count;
+        bit_count += code_size;
+        while (bit_count >= 8) {
+            block.push_back(static_cast<unsigned char>(bit_buffer & 0xff));
+            bit_buffer >>= 8;
+            bit_count -= 8;
+            if (block.size() == 255) flush_block();
+        }
+    }
+
+    /**
+     * @brief Compresses the current indices with GIF flavoured LZW and writes the data sub-blocks.
+     *
+     * The dictionary is a 4096 x 256 table of child codes, so extending a string is a single
+     * lookup. It is reset with a clear code when all 12 bit codes are used.
+     */
+    void write_lzw() {
+        const int min_code_size = 8;
+        const int clear_code = 1 << min_code_size;
+        const int end_code = clear_code + 1;
+
+        dictionary.assign(4096 * 256, 0);
+        block.clear();
+        bit_buffer = 0;
+        bit_count = 0;
+
+        std::fputc(min_code_size, out);
+
+        int code_size = min_code_size + 1;
+        int max_code = end_code;
+        write_code(clear_code, code_size);
+
+        int current = -1;
+        for (unsigned char value : indices) {
+            if (current < 0) {
+                current = value;
+                continue;
+            }
+
+            uint16_t& child = dictionary[static_cast<size_t>(current) * 256 + value];
+            if (child != 0) {
+                current = child;
+                continue;
+            }
+
+            write_code(current, code_size);
+            child = static_cast<uint16_t>(++max_code);
+            if (max_code >= (1 << code_size))
+                code_size++;
+
+            if (max_code == 4095) {
+                write_code(clear_code, code_size);
+                std::fill(dictionary.begin(), dictionary.end(), 0);
+                code_size = min_code_size + 1;
+                max_code = end_code;
+            }
+
+            current = value;
+        }
+
+        write_code(current, code_size);
+        write_code(clear_code, code_size);
+        write_code(end_code, min_code_size + 1);
+
+        if (bit_count > 0) {
+            block.push_back(static_cast<unsigned char>(bit_buffer & 0xff));
+            bit_buffer = 0;
+            bit_count = 0;
+        }
+        flush_block();
+        std::fputc(0x00, out); // Block terminator
+    }
+};
+
+#endif
@@ -0,0 +1,191 @@
+/**
+ * @file hdr_framebuffer.h
+ * @brief Contains the hdr_framebuffer class, a floating point image that accumulates linear radiance samples
+ */
+#ifndef HDR_FRAMEBUFFER_H
+#define HDR_FRAMEBUFFER_H
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "util/rtweekend.h"
+#include "framebuffer.h"
+
+/**
+ * @class hdr_framebuffer
+ * @brief Accumulates linear RGBA samples and per pixel sample counts in 32 bit floats.
+ *
+ * Samples are summed without any clamping or gamma, so several passes can be accumulated into
+ * the same buffer, merged from other buffers or exported losslessly. The alpha channel holds
+ * the pixel coverage and is 1 for every sample. Conversion to displayable 8 bit values only
+ * happens in tone_map, as a final pass over the whole buffer.
+ *
+ * @param width The width of the image in pixels.
+ * @param height The height of the image in pixels.
+ */
+class hdr_framebuffer {
+  public:
+    hdr_framebuffer() {}
+    hdr_framebuffer(int _width, int _height) { resize(_width, _height); }
+
+    void resize(int _width, int _height) {
+        width = _width;
+        height = _height;
+        sums.assign(static_cast<size_t>(width) * height * 4, 0.0f);
+        counts.assign(static_cast<size_t>(width) * height, 0);
+    }
+
+    /**
+     * Discards all accumulated samples.
+     */
+    void clear() {
+        std::fill(sums.begin(), sums.end(), 0.0f);
+        std::fill(counts.begin(), counts.end(), 0);
+    }
+
+    int get_width() const { return width; }
+    int get_height() const { return height; }
+
+    /**
+     * Adds one radiance sample to the pixel at i, j.
+     */
+    void add_sample(int i, int j, const color& sample) {
+        size_t index = static_cast<size_t>(j) * width + i;
+        float* p = &sums[index * 4];
+        p[0] += static_cast<float>(sample.x());
+        p[1] += static_cast<float>(sample.y());
+        p[2] += static_cast<float>(sample.z());
+        p[3] += 1.0f;
+        counts[index]++;
+    }
+
+    /**
+     * Adds n samples whose mean is mean to the pixel at i, j, as if each had been added alone.
+     */
+    void add_samples(int i, int j, const color& mean, uint32_t n) {
+        size_t index = static_cast<size_t>(j) * width + i;
+        float* p = &sums[index * 4];
+        p[0] += static_cast<float>(mean.x() * n);
+        p[1] += static_cast<float>(mean.y() * n);
+        p[2] += static_cast<float>(mean.z() * n);
+        p[3] += static_cast<float>(n);
+        counts[index] += n;
+    }
+
+    /**
+     * Adds all samples of another buffer of the same size to this one.
+     */
+    void merge(const hdr_framebuffer& other) {
+        for (size_t k = 0; k < sums.size(); k++)
+            sums[k] += other.sums[k];
+        for (size_t k = 0; k < counts.size(); k++)
+            counts[k] += other.counts[k];
+    }
+
+    /**
+     * Adds the samples that after holds and before does not, both of the size of this buffer.
+     * When after is before plus some new samples, this adds just the new samples.
+     */
+    void add_difference(const hdr_framebuffer& after, const hdr_framebuffer& before) {
+        for (size_t k = 0; k < sums.size(); k++)
+            sums[k] += after.sums[k] - before.sums[k];
+        for (size_t k = 0; k < counts.size(); k++)
+            counts[k] += after.counts[k] - before.counts[k];
+    }
+
+    uint32_t sample_count(int i, int j) const { return counts[static_cast<size_t>(j) * width + i]; }
+
+    /**
+     * @return the sum of all samples of the pixel at i, j
+     */
+    color sum(int i, int j) const {
+        const float* p = &sums[(static_cast<size_t>(j) * width + i) * 4];
+        return color(p[0], p[1], p[2]);
+    }
+
+    /**
+     * @return the mean linear color of the pixel at i, j, or black if it has no samples
+     */
+    color average(int i, int j) const {
+        uint32_t n = sample_count(i, j);
+        return n == 0 ? color(0,0,0) : sum(i, j) / n;
+    }
+
+    /**
+     * @brief Resolves the mean linear RGBA value of every pixel, top row first.
+     */
+    std::vector<float> resolve() const {
+        std::vector<float> rgba(sums.size());
+        for (size_t index = 0; index < counts.size(); index++) {
+            float scale = counts[index] == 0 ? 0.0f : 1.0f / counts[index];
+            for (int c = 0; c < 4; c++)
+                rgba[index * 4 + c] = sums[index * 4 + c] * scale;
+        }
+        return rgba;
+    }
+
+    /**
+     * @brief Converts the accumulated radiance to an 8 bit framebuffer.
+     *
+     * Each pixel is averaged, scaled by the exposure, optionally compressed with the Reinhard
+     * operator, gamma corrected and clamped to [0,255]. With SSE2 a whole RGBA pixel is processed
+     * per instruction.
+     *
+     * @param out the framebuffer that receives the image, resized if needed
+     * @param exposure the linear scale applied before tone mapping
+     * @param reinhard whether to apply x / (1 + x) instead of plain clamping
+     */
+    void tone_map(framebuffer& out, double exposure = 1.0, bool reinhard = false) const {
+        if (out.get_width() != width || out.get_height() != height)
+            out.resize(width, height);
+
+        unsigned char* bytes = out.data();
+        const size_t pixel_count = counts.size();
+
+#ifdef __SSE2__
+        const __m128 one = _mm_set1_ps(1.0f);
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 max_intensity = _mm_set1_ps(0.999f);
+        const __m128 to_byte = _mm_set1_ps(256.0f);
+
+        for (size_t index = 0; index < pixel_count; index++) {
+            float scale = counts[index] == 0 ? 0.0f : static_cast<float>(exposure) / counts[index];
+            __m128 c = _mm_mul_ps(_mm_loadu_ps(&sums[index * 4]), _mm_set1_ps(scale));
+            if (reinhard)
+                c = _mm_div_ps(c, _mm_add_ps(one, c));
+            c = _mm_sqrt_ps(_mm_max_ps(c, zero));
+            c = _mm_mul_ps(_mm_min_ps(c, max_intensity), to_byte);
+
+            alignas(16) int32_t rgb[4];
+            _mm_store_si128(reinterpret_cast<__m128i*>(rgb), _mm_cvttps_epi32(c));
+            bytes[index * 3]     = static_cast<unsigned char>(rgb[0]);
+            bytes[index * 3 + 1] = static_cast<unsigned char>(rgb[1]);
+            bytes[index * 3 + 2] = static_cast<unsigned char>(rgb[2]);
+        }
+#else
+        for (size_t index = 0; index < pixel_count; index++) {
+            float scale = counts[index] == 0 ? 0.0f : static_cast<float>(exposure) / counts[index];
+            for (int c = 0; c < 3; c++) {
+                float value = sums[index * 4 + c] * scale;
+                if (reinhard)
+                    value = value / (1.0f + value);
+                value = std::sqrt(std::max(value, 0.0f));
+                bytes[index * 3 + c] = static_cast<unsigned char>(256.0f * std::min(value, 0.999f));
+            }
+        }
+#endif
+    }
+
+  private:
+    int width = 0;
+    int height = 0;
+    std::vector<float> sums;      // RGBA sums, 4 floats per pixel
+    std::vector<uint32_t> counts; // Samples per pixel
+};
+
+#endif
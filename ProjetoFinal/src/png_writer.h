@@ -0,0 +1,445 @@
+/**
+ * @file png_writer.h
+ * @brief Contains a PNG encoder that filters and compresses horizontal stripes of the image in parallel
+ */
+#ifndef PNG_WRITER_H
+#define PNG_WRITER_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "framebuffer.h"
+#include "util/trace.h"
+
+namespace png_detail {
+
+struct crc32_table {
+    uint32_t entries[256];
+
+    crc32_table() {
+        for (uint32_t n = 0; n < 256; n++) {
+            uint32_t c = n;
+            for (int k = 0; k < 8; k++)
+                c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+            entries[n] = c;
+        }
+    }
+};
+
+inline uint32_t crc32(const unsigned char* data, size_t length, uint32_t crc = 0) {
+    static const crc32_table table;
+
+    crc = ~crc;
+    for (size_t k = 0; k < length; k++)
+        crc = table.entries[(crc ^ data[k]) & 0xff] ^ (crc >> 8);
+    return ~crc;
+}
+
+inline uint32_t adler32(const unsigned char* data, size_t length, uint32_t adler = 1) {
+    const uint32_t base = 65521;
+    uint32_t a = adler & 0xffff, b = adler >> 16;
+    while (length > 0) {
+        size_t block = std::min<size_t>(length, 5552); // Largest run that cannot overflow b
+        length -= block;
+        for (size_t k = 0; k < block; k++) {
+            a += data[k];
+            b += a;
+        }
+        data += block;
+        a %= base;
+        b %= base;
+    }
+    return (b << 16) | a;
+}
+
+/**
+ * @brief Computes the Adler-32 of two concatenated buffers from their separate checksums
+ *
+ * @param adler1 the checksum of the first buffer
+ * @param adler2 the checksum of the second buffer
+ * @param length2 the length of the second buffer
+ */
+inline uint32_t adler32_combine(uint32_t adler1, uint32_t adler2, size_t length2) {
+    const uint32_t base = 65521;
+    uint32_t remainder = static_cast<uint32_t>(length2 % base);
+    uint32_t sum1 = adler1 & 0xffff;
+    uint32_t sum2 = static_cast<uint32_t>((static_cast<uint64_t>(remainder) * sum1) % base);
+    sum1 += (adler2 & 0xffff) + base - 1;
+    sum2 += (adler1 >> 16) + (adler2 >> 16) + base - remainder;
+    if (sum1 >= base) sum1 -= base;
+    if (sum1 >= base) sum1 -= base;
+    if (sum2 >= 2 * base) sum2 -= 2 * base;
+    if (sum2 >= base) sum2 -= base;
+    return sum1 | (sum2 << 16);
+}
+
+inline unsigned char paeth(int a, int b, int c) {
+    int p = a + b - c, pa = std::abs(p - a), pb = std::abs(p - b), pc = std::abs(p - c);
+    if (pa <= pb && pa <= pc) return static_cast<unsigned char>(a);
+    if (pb <= pc) return static_cast<unsigned char>(b);
+    return static_cast<unsigned char>(c);
+}
+
+/**
+ * @brief Filters one row with the given PNG filter type into out
+ */
+inline void filter_row(const unsigned char* row, const unsigned char* above, int length, int bpp, int type, unsigned char* out) {
+    int k = 0;
+
+    // The first pixel has no left neighbour
+    for (; k < bpp && k < length; k++) {
+        int b = above ? above[k] : 0;
+        switch (type) {
+            case 2: out[k] = static_cast<unsigned char>(row[k] - b); break;
+            case 3: out[k] = static_cast<unsigned char>(row[k] - (b >> 1)); break;
+            case 4: out[k] = static_cast<unsigned char>(row[k] - b); break;
+            default: out[k] = row[k]; break;
+        }
+    }
+
+    if (above == nullptr) {
+        // Without a previous row, up is none, average only uses the left pixel and Paeth picks it
+        switch (type) {
+            case 0: case 2: for (; k < length; k++) out[k] = row[k]; break;
+            case 1: case 4: for (; k < length; k++) out[k] = static_cast<unsigned char>(row[k] - row[k - bpp]); break;
+            default: for (; k < length; k++) out[k] = static_cast<unsigned char>(row[k] - (row[k - bpp] >> 1)); break;
+        }
+        return;
+    }
+
+    switch (type) {
+        case 0: for (; k < length; k++) out[k] = row[k]; break;
+        case 1: for (; k < length; k++) out[k] = static_cast<unsigned char>(row[k] - row[k - bpp]); break;
+        case 2: for (; k < length; k++) out[k] = static_cast<unsigned char>(row[k] - above[k]); break;
+        case 3: for (; k < length; k++) out[k] = static_cast<unsigned char>(row[k] - ((row[k - bpp] + above[k]) >> 1)); break;
+        default:
+            for (; k < length; k++)
+                out[k] = static_cast<unsigned char>(row[k] - paeth(row[k - bpp], above[k], above[k - bpp]));
+            break;
+    }
+}
+
+/**
+ * @brief Filters the rows [first, last) of an RGB image, choosing the filter per row with the
+ * minimum sum of absolute differences heuristic also used by stb_image_write
+ */
+inline void filter_rows(const unsigned char* pixels, int width, int first, int last, unsigned char* out) {
+    const int length = width * 3;
+    std::vector<unsigned char> candidate(length);
+
+    for (int y = first; y < last; y++) {
+        const unsigned char* row = pixels + static_cast<size_t>(y) * length;
+        const unsigned char* above = y > 0 ? row - length : nullptr;
+        unsigned char* target = out + static_cast<size_t>(y) * (length + 1);
+
+        int best_type = 0;
+        long best_estimate = -1;
+        for (int type = 0; type < 5; type++) {
+            filter_row(row, above, length, 3, type, candidate.data());
+            long estimate = 0;
+            for (int k = 0; k < length; k++)
+                estimate += std::abs(static_cast<signed char>(candidate[k]));
+            if (best_estimate < 0 || estimate < best_estimate) {
+                best_estimate = estimate;
+                best_type = type;
+                std::memcpy(target + 1, candidate.data(), length);
+            }
+        }
+        target[0] = static_cast<unsigned char>(best_type);
+    }
+}
+
+/**
+ * @class deflate_stripe
+ * @brief Compresses one slice of a buffer into a fixed Huffman deflate block.
+ *
+ * This follows the LZ77 matcher of stb_image_write (hashed 3 byte prefixes, bucket length
+ * controlled by the quality, one step lazy matching), so both encoders compress alike at the
+ * same level. Matches may reach up to 32K back into the data preceding the slice, exactly as
+ * if the previous slices had been compressed in the same stream. A non final slice ends with
+ * an empty stored block (a sync flush), which leaves the output byte aligned so the slices can
+ * simply be concatenated.
+ */
+class deflate_stripe {
+  public:
+    deflate_stripe(int _quality)
+      : quality(_quality < 5 ? 5 : _quality), chains(hash_size * 2 * quality), chain_length(hash_size) {}
+
+    std::vector<unsigned char> compress(const unsigned char* data, size_t start, size_t end, bool final_block) {
+        static const unsigned short length_base[] = {3,4,5,6,7,8,9,10,11,13,15,17,19,23,27,31,35,43,51,59,67,83,99,115,131,163,195,227,258,259};
+        static const unsigned char  length_bits[] = {0,0,0,0,0,0,0,0,1,1,1,1,2,2,2,2,3,3,3,3,4,4,4,4,5,5,5,5,0};
+        static const unsigned short dist_base[]   = {1,2,3,4,5,7,9,13,17,25,33,49,65,97,129,193,257,385,513,769,1025,1537,2049,3073,4097,6145,8193,12289,16385,24577,32768};
+        static const unsigned char  dist_bits[]   = {0,0,0,0,1,1,2,2,3,3,4,4,5,5,6,6,7,7,8,8,9,9,10,10,11,11,12,12,13,13};
+
+        out.clear();
+        bit_buffer = 0;
+        bit_count = 0;
+        std::fill(chain_length.begin(), chain_length.end(), 0);
+
+        // Preset dictionary: the window of data before this slice
+        size_t window_start = start > window ? start - window : 0;
+        for (size_t i = window_start; i + 3 <= start; i++)
+            insert(data, i);
+
+        add(final_block ? 1 : 0, 1); // BFINAL
+        add(1, 2);                   // BTYPE = 1, fixed huffman
+
+        size_t i = start;
+        while (i + 3 < end) {
+            int best = 3;
+            long best_location = -1;
+            unsigned int h = hash(data + i);
+            for (const uint32_t* entry = bucket(h), *last = entry + chain_length[h]; entry != last; ++entry) {
+                size_t location = *entry;
+                // A candidate can only reach `best` if it agrees on the byte at best - 1
+                if (i - location < window && data[location + best - 1] == data[i + best - 1]) {
+                    int d = count_match(data + location, data + i, end - i);
+                    if (d >= best) { best = d; best_location = static_cast<long>(location); }
+                }
+            }
+            insert(data, i);
+
+            if (best_location >= 0) {
+                // Lazy matching: emit a literal if the next byte starts a longer match
+                unsigned int next = hash(data + i + 1);
+                for (const uint32_t* entry = bucket(next), *last = entry + chain_length[next]; entry != last; ++entry) {
+                    size_t location = *entry;
+                    if (i + 1 - location < window - 1 && location < i + 1
+                        && i + 1 + best < end && data[location + best] == data[i + 1 + best]) {
+                        int e = count_match(data + location, data + i + 1, end - i - 1);
+                        if (e > best) { best_location = -1; break; }
+                    }
+                }
+            }
+
+            if (best_location >= 0) {
+                int d = static_cast<int>(i - best_location);
+                int j;
+                for (j = 0; best > length_base[j + 1] - 1; ++j);
+                huffman(j + 257);
+                if (length_bits[j]) add(best - length_base[j], length_bits[j]);
+                for (j = 0; d > dist_base[j + 1] - 1; ++j);
+                add(bit_reverse(j, 5), 5);
+                if (dist_bits[j]) add(d - dist_base[j], dist_bits[j]);
+                i += best;
+            } else {
+                huffman(data[i]);
+                ++i;
+            }
+        }
+        for (; i < end; ++i)
+            huffman(data[i]);
+        huffman(256); // End of block
+
+        if (!final_block) {
+            add(0, 3); // Empty stored block
+            flush_to_byte();
+            out.push_back(0x00);
+            out.push_back(0x00);
+            out.push_back(0xff);
+            out.push_back(0xff);
+        } else {
+            flush_to_byte();
+        }
+
+        return out;
+    }
+
+  private:
+    static const size_t hash_size = 16384;
+    static const size_t window = 32768;
+
+    int quality;
+    std::vector<uint32_t> chains;       // hash_size buckets of up to 2 * quality positions
+    std::vector<int> chain_length;
+    std::vector<unsigned char> out;
+    uint32_t bit_buffer = 0;
+    int bit_count = 0;
+
+    static unsigned int hash(const unsigned char* data) {
+        uint32_t h = data[0] + (data[1] << 8) + (data[2] << 16);
+        h ^= h << 3;
+        h += h >> 5;
+        h ^= h << 4;
+        h += h >> 17;
+        h ^= h << 25;
+        h += h >> 6;
+        return h & (hash_size - 1);
+    }
+
+    uint32_t* bucket(unsigned int h) { return &chains[static_cast<size_t>(h) * 2 * quality]; }
+
+    void insert(const unsigned char* data, size_t i) {
+        unsigned int h = hash(data + i);
+        uint32_t* list = bucket(h);
+        // When the bucket is full, drop its older half
+        if (chain_length[h] == 2 * quality) {
+            std::memmove(list, list + quality, quality * sizeof(uint32_t));
+            chain_length[h] = quality;
+        }
+        list[chain_length[h]++] = static_cast<uint32_t>(i);
+    }
+
+    static int count_match(const unsigned char* a, const unsigned char* b, size_t limit) {
+        int k = 0;
+        while (static_cast<size_t>(k) < limit && k < 258 && a[k] == b[k]) k++;
+        return k;
+    }
+
+    static int bit_reverse(int code, int bits) {
+        int result = 0;
+        while (bits--) {
+            result = (result << 1) | (code & 1);
+            code >>= 1;
+        }
+        return result;
+    }
+
+    void add(uint32_t code, int bits) {
+        bit_buffer |= code << bit_count;
+        bit_count += bits;
+        while (bit_count >= 8) {
+            out.push_back(static_cast<unsigned char>(bit_buffer & 0xff));
+            bit_buffer >>= 8;
+            bit_count -= 8;
+        }
+    }
+
+    void flush_to_byte() {
+        if (bit_count > 0) add(0, 8 - bit_count);
+    }
+
+    // Fixed huffman codes of RFC 1951
+    void huffman(int n) {
+        if (n <= 143)      add(bit_reverse(0x30 + n, 8), 8);
+        else if (n <= 255) add(bit_reverse(0x190 + n - 144, 9), 9);
+        else if (n <= 279) add(bit_reverse(n - 256, 7), 7);
+        else               add(bit_reverse(0xc0 + n - 280, 8), 8);
+    }
+};
+
+inline void put_u32(std::vector<unsigned char>& out, uint32_t value) {
+    out.push_back(static_cast<unsigned char>(value >> 24));
+    out.push_back(static_cast<unsigned char>(value >> 16));
+    out.push_back(static_cast<unsigned char>(value >> 8));
+    out.push_back(static_cast<unsigned char>(value));
+}
+
+inline void put_chunk(std::vector<unsigned char>& out, const char* tag, const std::vector<unsigned char>& body) {
+    put_u32(out, static_cast<uint32_t>(body.size()));
+    size_t start = out.size();
+    out.insert(out.end(), tag, tag + 4);
+    out.insert(out.end(), body.begin(), body.end());
+    put_u32(out, crc32(out.data() + start, out.size() - start));
+}
+
+/**
+ * @brief Runs task(k) for k in [0, count) on up to `threads` threads
+ */
+template <typename Task>
+void parallel_for(int count, int threads, Task task) {
+    threads = std::max(1, std::min(threads, count));
+    std::vector<std::thread> pool;
+    for (int t = 1; t < threads; t++)
+        pool.emplace_back([&, t] {
+            TRACE_THREAD_NAME("png stripe worker");
+            for (int k = t; k < count; k += threads) task(k);
+        });
+    for (int k = 0; k < count; k += threads) task(k);
+    for (auto& thread : pool) thread.join();
+}
+
+} // namespace png_detail
+
+/**
+ * @brief Encodes a framebuffer as a PNG file in memory, using several threads.
+ *
+ * The image is split into horizontal stripes. The rows are filtered in parallel, then each
+ * stripe is deflated on its own thread, with the 32K of filtered data before it as preset
+ * dictionary, and the stripes are joined into a single zlib stream through sync flushes. The
+ * Adler-32 of the stream is combined from the per stripe checksums.
+ *
+ * @param image the framebuffer to encode
+ * @param threads the number of threads, or 0 for one per hardware thread
+ * @param quality the compression level, with the same meaning as stbi_write_png_compression_level
+ *
+ * @return the bytes of the PNG file
+ */
+inline std::vector<unsigned char> encode_png_parallel(const framebuffer& image, int threads = 0, int quality = 8) {
+    using namespace png_detail;
+
+    const int width = image.get_width();
+    const int height = image.get_height();
+    const size_t row_length = static_cast<size_t>(width) * 3 + 1;
+
+    if (threads <= 0)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+
+    // A few stripes per thread balances uneven compression costs
+    const int stripes = std::max(1, std::min(height, threads * 4));
+
+    std::vector<unsigned char> filtered(row_length * height);
+    parallel_for(stripes, threads, [&](int s) {
+        TRACE_SCOPE_INDEX("filter_stripe", s);
+        filter_rows(image.data(), width, height * s / stripes, height * (s + 1) / stripes, filtered.data());
+    });
+
+    std::vector<std::vector<unsigned char>> compressed(stripes);
+    std::vector<uint32_t> checksums(stripes);
+    parallel_for(stripes, threads, [&](int s) {
+        TRACE_SCOPE_INDEX("deflate_stripe", s);
+        size_t start = row_length * (height * s / stripes);
+        size_t end = row_length * (height * (s + 1) / stripes);
+        deflate_stripe encoder(quality);
+        compressed[s] = encoder.compress(filtered.data(), start, end, s == stripes - 1);
+        checksums[s] = adler32(filtered.data() + start, end - start);
+    });
+
+    uint32_t adler = 1;
+    for (int s = 0; s < stripes; s++) {
+        size_t length = row_length * (height * (s + 1) / stripes) - row_length * (height * s / stripes);
+        adler = adler32_combine(adler, checksums[s], length);
+    }
+
+    std::vector<unsigned char> zlib = {0x78, 0x5e}; // 32K window, default compression
+    for (const auto& stripe : compressed)
+        zlib.insert(zlib.end(), stripe.begin(), stripe.end());
+    put_u32(zlib, adler);
+
+    std::vector<unsigned char> png = {137, 80, 78, 71, 13, 10, 26, 10};
+
+    std::vector<unsigned char> header;
+    put_u32(header, static_cast<uint32_t>(width));
+    put_u32(header, static_cast<uint32_t>(height));
+    header.insert(header.end(), {8, 2, 0, 0, 0}); // 8 bit RGB, no interlacing
+    put_chunk(png, "IHDR", header);
+    put_chunk(png, "IDAT", zlib);
+    put_chunk(png, "IEND", std::vector<unsigned char>());
+
+    return png;
+}
+
+/**
+ * @brief Saves a framebuffer as a PNG file, encoding it with several threads.
+ *
+ * @param filename the name of the PNG file
+ * @param image the framebuffer to save
+ * @param threads the number of threads, or 0 for one per hardware thread
+ * @param quality the compression level, with the same meaning as stbi_write_png_compression_level
+ *
+ * @return true if the file was written
+ */
+inline bool write_png_parallel(const std::string& filename, const framebuffer& image, int threads = 0, int quality = 8) {
+    std::vector<unsigned char> png = encode_png_parallel(image, threads, quality);
+    std::ofstream out(filename, std::ios::binary);
+    out.write(reinterpret_cast<const char*>(png.data()), png.size());
+    return static_cast<bool>(out);
+}
+
+#endif
@@ -9,6 +9,7 @@
 #include <string>
 #include <fstream>
 #include <chrono>
+#include <cstdlib>
 
 using namespace std::chrono;
 
@@ -23,95 +24,371 @@ using namespace std::chrono;
 #include "export_image.cpp"
 #include "color.h"
 #include "camera.h"
-#include "circular_animation.h"
+#include "scenes.h"
+#include "frame_encoder.h"
+#include "y4m_writer.h"
+#include "gif_writer.h"
+#include "util/render_stats.h"
+#include "util/trace.h"
 
 point3 circle_path(point3 &center, double radius, double step) {
     double t = degrees_to_radians(step);
     return center + radius * vec3(sin(t), 0, cos(t));
 }
 
+/**
+ * @brief Writes the trace recorded so far, if tracing is compiled in and a path was given
+ */
+void write_trace(const std::string& path) {
+#ifdef RT_ENABLE_TRACE
+    if (!path.empty())
+        trace_recorder::write(path);
+#else
+    (void)path;
+#endif
+}
+
+/**
+ * @brief Writes the mean, minimum and maximum samples taken per pixel, and the fraction of
+ * samples saved compared with taking the maximum on every pixel
+ */
+void write_sample_counts(std::ostream& out, const hdr_framebuffer& radiance, int max_samples) {
+    uint64_t total = 0;
+    uint32_t fewest = UINT32_MAX, most = 0;
+    for (int j = 0; j < radiance.get_height(); j++) {
+        for (int i = 0; i < radiance.get_width(); i++) {
+            uint32_t n = radiance.sample_count(i, j);
+            total += n;
+            fewest = std::min(fewest, n);
+            most = std::max(most, n);
+        }
+    }
+    double pixels = static_cast<double>(radiance.get_width()) * radiance.get_height();
+    out << "Samples per pixel: mean " << total / pixels << ", min " << fewest << ", max " << most
+        << ", " << 100 * (1 - total / (pixels * max_samples)) << "% fewer than " << max_samples << "." << std::endl;
+}
+
 /**
  * @brief The main function that creates and places the objects, the camera, and the animations in the scene and renders it
+ *
+ * By default every frame is saved as `frame_<n>.png`. With `--y4m <file>` the frames are streamed
+ * as a single YUV4MPEG2 video instead, and `--y4m -` writes it to the standard output so it can be
+ * piped into an encoder. With `--gif <file>` the frames are encoded into an animated GIF preview.
+ * PNG frames are only saved when neither option is given.
+ *
+ * `--poster <file> <width>` renders only the first frame, at the given width, streaming it to a
+ * `.png` or `.ppm` file band by band so that very large images fit in memory.
+ *
+ * Ray and intersection statistics are reported after every frame. `--stats-json <file>` also
+ * writes them to a file, one JSON object per line and frame.
+ *
+ * `--heatmap time|tests|samples` also saves `heatmap_<n>.png` for every frame, a false color image
+ * of the time, the intersection tests or the samples spent on each pixel.
+ *
+ * `--adaptive <min samples> <noise>` samples each pixel only until its noise falls below the given
+ * level, taking between min samples and the camera's samples per pixel. The realised samples per
+ * pixel are reported after every frame.
+ *
+ * `--sampler independent|sobol|halton|blue_noise` selects the sequence the pixel samples and the
+ * bounces draw their random numbers from (see sampler.h).
+ *
+ * `--progressive <milliseconds> <noise>` renders every frame in passes of a few samples per pixel,
+ * stopping at the time budget or once the image noise falls below the given level (0 for no
+ * limit). With `--save-passes` the image after every pass is saved as `frame_<n>_pass_<k>.png`.
+ *
+ * `--denoise` filters every frame with the camera's edge avoiding denoiser (see atrous_denoiser),
+ * which lets frames with far fewer samples per pixel look clean. `--spp <samples>` sets the
+ * samples per pixel of the camera. `--temporal` carries the samples of every frame over to the next
+ * one (see temporal_accumulator), so each frame can take fewer of its own.
+ *
+ * `--aovs exr|pfm|png` also saves, for every frame, what the camera rays hit first, taken from the
+ * same samples as the image: the depth, normal, albedo, position and object and material ids. exr
+ * writes them as layers of `frame_<n>.exr` next to the linear image, pfm as `frame_<n>_depth.pfm`
+ * and so on, and png as 8 bit previews `frame_<n>_depth.png` and so on, without the position.
+ *
+ * `--stress <spheres> <stars> <triangles>` renders a single frame of a generated stress scene
+ * (see stress_scene) instead of the animation, and `--lights` a still lit only by small lights
+ * (see lights_scene).
+ *
+ * In builds configured with `-DRT_ENABLE_TRACE=ON`, `--trace <file>` writes a Chrome trace of the
+ * loading, rendering and encoding phases of every frame.
  */
-int main() {
+int main(int argc, char* argv[]) {
+    std::string y4m_path; // Empty when not streaming video
+    std::string gif_path; // Empty when not writing a GIF preview
+    std::string poster_path; // Empty when rendering the animation
+    int poster_width = 0;
+    std::string stats_path; // Empty when the statistics are only printed
+    heatmap_mode heatmap = heatmap_off;
+    std::string trace_path; // Empty when no trace is written
+    bool stress = false;
+    int stress_spheres = 0, stress_stars = 0;
+    long stress_triangles = 0;
+    bool lights = false;
+    bool denoise = false;
+    bool temporal = false;
+    std::string aovs_format; // Empty when the first hits are not saved
+    int samples_per_pixel = 0; // 0 keeps the scene's own
+    int adaptive_min_samples = 0; // 0 when every pixel takes the same samples
+    double adaptive_noise = 0;
+    bool progressive = false;
+    double progressive_budget_ms = 0, progressive_noise = 0;
+    bool save_passes = false;
+    sampler_kind sampling = sampler_independent;
+
+    for (int a = 1; a < argc; a++) {
+        std::string arg = argv[a];
+        if (arg == "--y4m" && a + 1 < argc) {
+            y4m_path = argv[++a];
+        } else if (arg == "--gif" && a + 1 < argc) {
+            gif_path = argv[++a];
+        } else if (arg == "--poster" && a + 2 < argc) {
+            poster_path = argv[++a];
+            poster_width = std::atoi(argv[++a]);
+            if (poster_width < 1) {
+                std::cerr << "Error: Invalid poster width " << argv[a] << ", expected a positive number of pixels" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--stats-json" && a + 1 < argc) {
+            stats_path = argv[++a];
+        } else if (arg == "--heatmap" && a + 1 < argc) {
+            std::string mode = argv[++a];
+            if (mode == "time") heatmap = heatmap_time;
+            else if (mode == "tests") heatmap = heatmap_tests;
+            else if (mode == "samples") heatmap = heatmap_samples;
+            else {
+                std::cerr << "Error: Unknown heatmap " << mode << ", expected time, tests or samples" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--adaptive" && a + 2 < argc) {
+            adaptive_min_samples = std::atoi(argv[++a]);
+            adaptive_noise = std::atof(argv[++a]);
+        } else if (arg == "--stress" && a + 3 < argc) {
+            stress = true;
+            stress_spheres = std::atoi(argv[++a]);
+            stress_stars = std::atoi(argv[++a]);
+            stress_triangles = std::atol(argv[++a]);
+        } else if (arg == "--lights") {
+            lights = true;
+        } else if (arg == "--denoise") {
+            denoise = true;
+        } else if (arg == "--temporal") {
+            temporal = true;
+        } else if (arg == "--aovs" && a + 1 < argc) {
+            aovs_format = argv[++a];
+            if (aovs_format != "exr" && aovs_format != "pfm" && aovs_format != "png") {
+                std::cerr << "Error: Unknown AOV format " << aovs_format << ", expected exr, pfm or png" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--spp" && a + 1 < argc) {
+            samples_per_pixel = std::atoi(argv[++a]);
+        } else if (arg == "--progressive" && a + 2 < argc) {
+            progressive = true;
+            progressive_budget_ms = std::atof(argv[++a]);
+            progressive_noise = std::atof(argv[++a]);
+        } else if (arg == "--sampler" && a + 1 < argc) {
+            std::string name = argv[++a];
+            if (name == "independent") sampling = sampler_independent;
+            else if (name == "sobol") sampling = sampler_sobol;
+            else if (name == "halton") sampling = sampler_halton;
+            else if (name == "blue_noise") sampling = sampler_blue_noise;
+            else {
+                std::cerr << "Error: Unknown sampler " << name << ", expected independent, sobol, halton or blue_noise" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--save-passes") {
+            save_passes = true;
+        } else if (arg == "--trace" && a + 1 < argc) {
+#ifdef RT_ENABLE_TRACE
+            trace_path = argv[++a];
+#else
+            std::cerr << "Error: Tracing is disabled in this build, configure it with -DRT_ENABLE_TRACE=ON" << std::endl;
+            return 1;
+#endif
+        } else {
+            std::cerr << "Usage: " << argv[0] << " [--y4m <file|->] [--gif <file>] [--poster <file> <width>]"
+                      << " [--stats-json <file>] [--heatmap time|tests|samples] [--stress <spheres> <stars> <triangles>] [--lights] [--denoise] [--temporal] [--spp <samples>]"
+                      << " [--aovs exr|pfm|png] [--adaptive <min samples> <noise>] [--progressive <milliseconds> <noise> [--save-passes]]"
+                      << " [--sampler independent|sobol|halton|blue_noise] [--trace <file>]" << std::endl;
+            return 1;
+        }
+    }
+
+    // Reports go to stderr when the video itself is written to stdout
+    std::ostream& report = y4m_path == "-" ? std::clog : std::cout;
+
+    std::ofstream stats_json;
+    if (!stats_path.empty()) {
+        stats_json.open(stats_path);
+        if (!stats_json) {
+            std::cerr << "Error: Could not open " << stats_path << std::endl;
+            return 1;
+        }
+    }
+
     // For calculating rendering time
     auto start = high_resolution_clock::now();
+    TRACE_THREAD_NAME("main");
+
+    // The scene, its camera and its animation are shared with the benchmarks
+    scene final_scene = stress ? stress_scene(stress_spheres, stress_stars, stress_triangles)
+                      : lights ? lights_scene() : projeto_final_scene();
+    hittable_list& world = final_scene.world;
+    camera& camera = final_scene.cameras[0];
+    camera.heatmap = heatmap;
+    if (adaptive_min_samples > 0) {
+        camera.min_samples_per_pixel = adaptive_min_samples;
+        camera.noise_threshold = adaptive_noise;
+    }
+    camera.sampling = sampling;
+    camera.denoise = denoise;
+    camera.temporal = temporal;
+    camera.save_aovs = !aovs_format.empty();
+    if (samples_per_pixel > 0) camera.samples_per_pixel = samples_per_pixel;
+    camera.time_budget_ms = progressive_budget_ms;
+    camera.target_noise = progressive_noise;
+
+    int frames_per_second = final_scene.frames_per_second;
+    int total_frames = final_scene.frame_count;
+
+    // Single large still, written band by band
+    if (!poster_path.empty()) {
+        camera.image_width = poster_width;
+        final_scene.set_frame(0);
+
+        std::unique_ptr<band_writer> poster;
+        if (poster_path.size() >= 4 && poster_path.compare(poster_path.size() - 4, 4, ".ppm") == 0)
+            poster.reset(new ppm_band_writer(poster_path));
+        else
+            poster.reset(new png_band_writer(poster_path));
+
+        {
+            TRACE_SCOPE("poster");
+            if (!camera.render_streaming(world, *poster))
+                return 1;
+        }
 
-    hittable_list world; // list of all objects in the scene
-
-    // Materials used
-    auto diffuse_maroon = make_shared<lambertian>(color(0.5, 0.0, 0.0));
-    auto diffuse_blue   = make_shared<lambertian>(color(0.2, 0.2, 0.3));
-    auto metal_gold     = make_shared<metal>(color(0.8, 0.6, 0.2), 0.3);
-    auto glass          = make_shared<dielectric>(1.5);
-
-    // Object creation
-    shared_ptr<object> star = make_shared<object>("../resources/20facestar.obj", metal_gold, .8, vec3(0, 2, 0), vec3(-90, 0, 0));
-    shared_ptr<sphere> ground = make_shared<sphere>(point3(0.0, -100, -1.0), 100.0, diffuse_blue);
-    shared_ptr<sphere> sphere1 = make_shared<sphere>(point3(0,1,-2), 1.2, diffuse_maroon);
-    shared_ptr<sphere> sphere2 = make_shared<sphere>(point3(0,3,-4), 1.2, glass);
-
-    // Object placement
-    world.add(star);
-    world.add(ground);
-    world.add(sphere1);
-    world.add(sphere2);
-
-    // Camera setup
-    camera camera;
-
-    camera.aspect_ratio      = 16.0 / 9.0;
-    camera.image_width       = 1024;
-    camera.samples_per_pixel = 100;
-    camera.max_depth         = 50;
-    camera.vfov     = 90;
-    camera.lookat   = point3(0,1,0);
-    camera.vup      = vec3(0,1,0);
-
-    // Animation setup
-    int duration = 5;
-    int frames_per_second = 15;
-    int total_frames = duration * frames_per_second;
-
-    circular_animation camera_anim = circular_animation(
-        point3(0, 4, 0),
-        7.0,
-        360.0/total_frames
-    );
-
-    circular_animation sphere1_anim = circular_animation(
-        point3(0, 1, 0),
-        3,
-        720.0/total_frames
-    );
+        auto poster_duration = std::chrono::duration<double>(high_resolution_clock::now() - start);
+        render_counters stats = render_stats::collect();
+        report << "\rPoster rendering time: " << poster_duration.count() << " seconds." << std::endl;
+        stats.write_summary(report, poster_duration.count());
+        if (stats_json.is_open()) {
+            stats_json << "{\"frame\":0,\"render_ms\":" << poster_duration.count() * 1000 << ",";
+            stats.write_json_fields(stats_json);
+            stats_json << "}" << std::endl;
+        }
+        write_trace(trace_path);
+        return 0;
+    }
+
+    // Frames are saved to PNG in the background while the next one renders
+    frame_encoder encoder(2, 2, report);
+    std::unique_ptr<y4m_writer> video;
+    if (!y4m_path.empty()) {
+        video.reset(new y4m_writer(y4m_path, frames_per_second));
+        if (!video->is_open()) return 1;
+    }
+    std::unique_ptr<gif_writer> preview;
+    if (!gif_path.empty()) {
+        preview.reset(new gif_writer(gif_path, frames_per_second));
+        if (!preview->is_open()) return 1;
+    }
+    bool save_png = !video && !preview;
 
     // Frame rendering
     for (int i = 0; i < total_frames; i++) {
+        TRACE_SCOPE_INDEX("frame", i);
         // For calculating frame rendering time
         auto frame_start = high_resolution_clock::now();
         
-        // camera animation
-        camera.lookfrom = camera_anim.get_position(i);
-        // maroon sphere animation
-        sphere1->set_center(sphere1_anim.get_position(i));
+        // camera, maroon sphere and star animation
+        final_scene.set_frame(i);
+        camera.seed = i;
         // render frame
-        camera.render(world, "frame_" + std::to_string(i));
-        // star rotation
-        star->rotate(vec3(0, 0, 216/total_frames));
+        int progressive_samples = 0;
+        if (progressive) {
+            progressive_samples = camera.render_progressive(world, [&](int pass, int) {
+                if (save_passes)
+                    encoder.submit(camera.frame(), "frame_" + std::to_string(i) + "_pass_" + std::to_string(pass) + ".png", i);
+            });
+        } else {
+            camera.render(world);
+        }
+        auto render_stop = high_resolution_clock::now();
+        render_counters stats = render_stats::collect();
+        // hand the frame to the encoders, waiting only if they fell behind
+        milliseconds encoder_wait(0);
+        float heat_scale = 0;
+        if (video) {
+            TRACE_SCOPE_INDEX("y4m_write", i);
+            video->write_frame(camera.frame());
+        }
+        if (preview) {
+            TRACE_SCOPE_INDEX("gif_write", i);
+            preview->write_frame(camera.frame());
+        }
+        if (save_png)
+            encoder_wait = encoder.submit(camera.frame(), "frame_" + std::to_string(i) + ".png", i);
+        if (heatmap != heatmap_off) {
+            framebuffer heat;
+            heat_scale = camera.frame_cost().to_image(heat);
+            encoder_wait += encoder.submit(heat, "heatmap_" + std::to_string(i) + ".png", i);
+        }
+        if (aovs_format == "exr") {
+            TRACE_SCOPE_INDEX("aovs_write", i);
+            saveToExr("frame_" + std::to_string(i) + ".exr", camera.frame_output(), exr_rle_compression, &camera.frame_features());
+        } else if (aovs_format == "pfm") {
+            TRACE_SCOPE_INDEX("aovs_write", i);
+            saveAovsToPfm("frame_" + std::to_string(i), camera.frame_features());
+        } else if (aovs_format == "png") {
+            TRACE_SCOPE_INDEX("aovs_write", i);
+            saveAovsToPng("frame_" + std::to_string(i), camera.frame_features());
+        }
 
         // Frame rendering time report
         auto frame_Stop = high_resolution_clock::now();
-        auto frame_duration = duration_cast<std::chrono::seconds>(frame_Stop - frame_start);
-        std::cout << "\rFrame " << i << " Rendering time: "
-         << frame_duration.count() << " seconds. "
-         << "Estimated remaining time: " << (total_frames - i - 1) * frame_duration.count() << " seconds." << std::endl;
+        auto render_duration = std::chrono::duration<double, std::milli>(render_stop - frame_start);
+        auto frame_duration = std::chrono::duration<double>(frame_Stop - frame_start);
+        report << "\rFrame " << i << " Rendering time: "
+         << render_duration.count() << " ms. "
+         << "Waiting for encoder: " << encoder_wait.count() << " ms. "
+         << "Estimated remaining time: " << static_cast<long>((total_frames - i - 1) * frame_duration.count()) << " seconds." << std::endl;
+        stats.write_summary(report, render_duration.count() / 1000);
+        if (heatmap != heatmap_off)
+            report << "Heatmap scale: " << heat_scale
+                   << (heatmap == heatmap_time ? " us" : heatmap == heatmap_tests ? " tests" : " samples") << " per pixel." << std::endl;
+        if (progressive) {
+            report << "Progressive: " << progressive_samples << " samples per pixel";
+            if (camera.last_noise_estimate() >= 0)
+                report << ", noise " << camera.last_noise_estimate();
+            report << "." << std::endl;
+        }
+        if (adaptive_min_samples > 0 && !progressive)
+            write_sample_counts(report, camera.frame_radiance(), camera.samples_per_pixel);
+
+        if (stats_json.is_open()) {
+            stats_json << "{\"frame\":" << i << ",\"render_ms\":" << render_duration.count()
+                       << ",\"encoder_wait_ms\":" << encoder_wait.count() << ",";
+            stats.write_json_fields(stats_json);
+            stats_json << "}" << std::endl;
+        }
     }
 
+    encoder.finish();
+    if (video)
+        video->close();
+    if (preview)
+        preview->close();
+    if (save_png)
+        report << "Total encoding time: " << encoder.total_encoding_time().count() << " ms." << std::endl;
+
     // Animation rendering time report
     auto stop = high_resolution_clock::now();
     auto rendering_duration = duration_cast<minutes>(stop - start);
-    std::cout << "Rendering time: "
+    report << "Rendering time: "
          << rendering_duration.count() << " minutes." << std::endl;
 
+    write_trace(trace_path);
+
     return 0; 
 }
@@ -0,0 +1,89 @@
+/**
+ * @file render_profile.h
+ * @brief Contains the render_profile class, which records how the work of a render was spread over its threads
+ */
+#ifndef RENDER_PROFILE_H
+#define RENDER_PROFILE_H
+
+#include <algorithm>
+#include <ostream>
+#include <vector>
+
+/**
+ * @brief The position and render time of one tile
+ */
+struct tile_time {
+    int x = 0, y = 0;          // Top left pixel
+    int width = 0, height = 0; // Size in pixels
+    int thread = 0;            // Index of the thread that rendered it
+    double ms = 0;
+};
+
+/**
+ * @class render_profile
+ * @brief The wall time of a render, the busy time of each of its threads and the time of each tile.
+ *
+ * A thread is idle while it waits for the others to finish their last tile. The tail is the time
+ * from the moment the first thread ran out of tiles to the end of the render, which grows when a
+ * few expensive tiles are left for last.
+ */
+class render_profile {
+  public:
+    double wall_ms = 0;
+    double tail_ms = 0;
+    double denoise_ms = 0;
+    double temporal_ms = 0;
+    std::vector<double> busy_ms; // Per thread
+    std::vector<tile_time> tiles;
+
+    void reset(int threads) {
+        wall_ms = 0;
+        tail_ms = 0;
+        denoise_ms = 0;
+        temporal_ms = 0;
+        busy_ms.assign(threads, 0.0);
+        tiles.clear();
+    }
+
+    int thread_count() const { return static_cast<int>(busy_ms.size()); }
+
+    double idle_ms(int thread) const { return std::max(0.0, wall_ms - busy_ms[thread]); }
+
+    /**
+     * @return the fraction of the threads' time spent rendering, 1 for a perfect balance
+     */
+    double balance() const {
+        if (busy_ms.empty() || wall_ms <= 0) return 0;
+        double busy = 0;
+        for (double ms : busy_ms) busy += ms;
+        return busy / (wall_ms * busy_ms.size());
+    }
+
+    /**
+     * @return the tile that took the longest, or an empty tile if nothing was rendered
+     */
+    tile_time slowest_tile() const {
+        tile_time slowest;
+        for (const tile_time& tile : tiles)
+            if (tile.ms > slowest.ms) slowest = tile;
+        return slowest;
+    }
+
+    /**
+     * Writes the busy and idle time of every thread, the tail and the slowest tile.
+     */
+    void write_summary(std::ostream& out) const {
+        out << "Threads: " << thread_count() << ", tiles: " << tiles.size() << ", wall " << wall_ms
+            << " ms, tail " << tail_ms << " ms, balance " << balance() * 100 << "%";
+        if (temporal_ms > 0) out << ", temporal " << temporal_ms << " ms";
+        if (denoise_ms > 0) out << ", denoise " << denoise_ms << " ms";
+        out << std::endl;
+        for (int t = 0; t < thread_count(); t++)
+            out << "  thread " << t << ": busy " << busy_ms[t] << " ms, idle " << idle_ms(t) << " ms" << std::endl;
+        tile_time slowest = slowest_tile();
+        out << "  slowest tile: " << slowest.ms << " ms at (" << slowest.x << ", " << slowest.y << "), "
+            << slowest.width << "x" << slowest.height << std::endl;
+    }
+};
+
+#endif
@@ -0,0 +1,375 @@
+/**
+ * @file scenes.h
+ * @brief Contains the scenes rendered by the project and its benchmarks
+ *
+ * Keeping the scenes here lets the animation and the benchmarks render exactly the same objects,
+ * materials and cameras. camera.h needs saveToPng, so export_image.cpp must be included first.
+ */
+#ifndef SCENES_H
+#define SCENES_H
+
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "util/rtweekend.h"
+
+#include "geometry/face_data.h"
+#include "geometry/hittable_list.h"
+#include "geometry/instance.h"
+#include "geometry/material.h"
+#include "geometry/object.h"
+#include "geometry/sphere.h"
+
+#include "camera.h"
+#include "circular_animation.h"
+
+/**
+ * @class scene
+ * @brief A world, the cameras that view it and how both move along an animation.
+ *
+ * @param name A short name, used in reports.
+ * @param world The objects of the scene.
+ * @param cameras The cameras, each one a separate view of the world.
+ * @param frame_count The number of frames of the animation, 1 for a still.
+ * @param frames_per_second The playback rate of the animation.
+ * @param lights The emissive objects of the world, which the cameras sample with shadow rays.
+ */
+class scene {
+  public:
+    std::string name;
+    hittable_list world;
+    std::vector<camera> cameras;
+    int frame_count = 1;
+    int frames_per_second = 1;
+    shared_ptr<hittable_list> lights = make_shared<hittable_list>();
+
+    /**
+     * Adds an emissive object both to the world and to the lights.
+     */
+    void add_light(shared_ptr<hittable> object) {
+        world.add(object);
+        lights->add(object);
+    }
+
+    /**
+     * Moves the objects and cameras to where they are in the given frame.
+     */
+    void set_frame(int frame) {
+        if (animate) animate(*this, frame);
+    }
+
+    std::function<void(scene&, int)> animate; // Empty for still scenes
+};
+
+/**
+ * @brief The scene of the final project: a metal star, a diffuse and a glass sphere over a large
+ * diffuse ground, seen by a camera that circles it.
+ *
+ * The camera turns 360 degrees around the scene, the maroon sphere turns 720 degrees around the
+ * star and the star turns around its own axis.
+ *
+ * @param resource_dir the directory holding the .obj files
+ */
+inline scene projeto_final_scene(const std::string& resource_dir = "../resources") {
+    scene s;
+    s.name = "projeto_final";
+
+    // Materials used
+    auto diffuse_maroon = make_shared<lambertian>(color(0.5, 0.0, 0.0));
+    auto diffuse_blue   = make_shared<lambertian>(color(0.2, 0.2, 0.3));
+    auto metal_gold     = make_shared<metal>(color(0.8, 0.6, 0.2), 0.3);
+    auto glass          = make_shared<dielectric>(1.5);
+
+    // Object creation
+    shared_ptr<object> star = make_shared<object>(resource_dir + "/20facestar.obj", metal_gold, .8, vec3(0, 2, 0), vec3(-90, 0, 0));
+    shared_ptr<sphere> ground = make_shared<sphere>(point3(0.0, -100, -1.0), 100.0, diffuse_blue);
+    shared_ptr<sphere> sphere1 = make_shared<sphere>(point3(0,1,-2), 1.2, diffuse_maroon);
+    shared_ptr<sphere> sphere2 = make_shared<sphere>(point3(0,3,-4), 1.2, glass);
+    sphere2->opaque = false;
+
+    // Object placement
+    s.world.add(star);
+    s.world.add(ground);
+    s.world.add(sphere1);
+    s.world.add(sphere2);
+
+    // Camera setup
+    camera cam;
+
+    cam.aspect_ratio      = 16.0 / 9.0;
+    cam.image_width       = 1024;
+    cam.samples_per_pixel = 100;
+    cam.max_depth         = 50;
+    cam.vfov     = 90;
+    cam.lookat   = point3(0,1,0);
+    cam.vup      = vec3(0,1,0);
+    s.cameras.push_back(cam);
+
+    // Animation setup
+    int duration = 5;
+    s.frames_per_second = 15;
+    s.frame_count = duration * s.frames_per_second;
+    const int total_frames = s.frame_count;
+
+    circular_animation camera_anim = circular_animation(
+        point3(0, 4, 0),
+        7.0,
+        360.0/total_frames
+    );
+
+    circular_animation sphere1_anim = circular_animation(
+        point3(0, 1, 0),
+        3,
+        720.0/total_frames
+    );
+
+    // The star rotation accumulates, so remember which frame it is at
+    int star_frame = 0;
+    s.animate = [=](scene& target, int frame) mutable {
+        target.cameras[0].lookfrom = camera_anim.get_position(frame);
+        sphere1->set_center(sphere1_anim.get_position(frame));
+        if (frame != star_frame) {
+            star->rotate(vec3(0, 0, (216/total_frames) * (frame - star_frame)));
+            star_frame = frame;
+        }
+    };
+    s.set_frame(0);
+
+    return s;
+}
+
+/**
+ * @brief The still scene of Atividade05: a pyramid, a star and a cube over a large ground, seen
+ * by two cameras.
+ *
+ * Atividade05 had no materials and halved the light at every bounce, which is a grey lambertian
+ * material here. The meshes are placed with this project's object transforms.
+ *
+ * @param resource_dir the directory holding the .obj files
+ */
+inline scene atividade05_scene(const std::string& resource_dir = "../resources") {
+    scene s;
+    s.name = "atividade05";
+
+    auto grey = make_shared<lambertian>(color(0.5, 0.5, 0.5));
+
+    s.world.add(make_shared<object>(resource_dir + "/tri-pyramid.obj", grey, 100, vec3(-6, 2, -14), vec3(0, 30, 0)));
+    s.world.add(make_shared<object>(resource_dir + "/20facestar.obj", grey, 1, vec3(0, -2, -2), vec3(90, 0, 0)));
+    s.world.add(make_shared<object>(resource_dir + "/cube.ply", grey, 2, vec3(4, 1.5, 0), vec3(30, 45, 0)));
+    s.world.add(make_shared<sphere>(point3(0,-100,-1), 100, grey)); // Ground
+
+    camera camera1, camera2;
+
+    camera1.aspect_ratio      = 16.0 / 9.0;
+    camera1.image_width       = 400;
+    camera1.samples_per_pixel = 200;
+    camera1.max_depth         = 50;
+
+    camera1.vfov     = 60;
+    camera1.lookfrom = point3(0,3,-15);
+    camera1.lookat   = point3(0,2,0);
+    camera1.vup      = vec3(0,1,0);
+
+    camera2.aspect_ratio      = 16.0 / 9.0;
+    camera2.image_width       = 400;
+    camera2.samples_per_pixel = 200;
+    camera2.max_depth         = 50;
+
+    camera2.vfov     = 60;
+    camera2.lookfrom = point3(8,10,7);
+    camera2.lookat   = point3(0,0,0);
+    camera2.vup      = vec3(0,1,0);
+
+    s.cameras.push_back(camera1);
+    s.cameras.push_back(camera2);
+
+    return s;
+}
+
+/**
+ * @brief A still lit only by a small, bright sphere and a rectangular panel, under a nearly black
+ * sky: a diffuse, a metal and a glass sphere on a diffuse ground.
+ *
+ * Bounces alone rarely find such small lights, so this scene shows the noise that the shadow rays
+ * toward the lights remove. The glass sphere lets the shadow rays through, so it casts no
+ * shadow from the lights. The panel is a two triangle mesh that faces down.
+ */
+inline scene lights_scene() {
+    scene s;
+    s.name = "lights";
+
+    auto ground = make_shared<lambertian>(color(0.5, 0.5, 0.5));
+    auto diffuse_maroon = make_shared<lambertian>(color(0.6, 0.1, 0.1));
+    auto metal_gold = make_shared<metal>(color(0.8, 0.6, 0.2), 0.2);
+    auto glass = make_shared<dielectric>(1.5);
+
+    // The lights are above the ground, so it cannot shadow anything
+    auto floor = make_shared<sphere>(point3(0, -1000, 0), 1000, ground);
+    floor->visibility = ray_camera | ray_secondary;
+    s.world.add(floor);
+    s.world.add(make_shared<sphere>(point3(-1.3, 0.6, 0), 0.6, diffuse_maroon));
+    s.world.add(make_shared<sphere>(point3(1.3, 0.6, 0), 0.6, metal_gold));
+    auto glass_sphere = make_shared<sphere>(point3(0, 0.45, 1.2), 0.45, glass);
+    glass_sphere->opaque = false; // Shadow rays pass through it
+    s.world.add(glass_sphere);
+
+    s.add_light(make_shared<sphere>(point3(0.6, 2.2, 1.0), 0.12, make_shared<diffuse_light>(color(60, 50, 40))));
+
+    std::vector<point3> corners = {point3(-2, 3, -1.5), point3(-1, 3, -1.5), point3(-1, 3, -0.5), point3(-2, 3, -0.5)};
+    std::vector<vec3> down = {vec3(0, -1, 0)};
+    std::vector<face_data> faces(2);
+    faces[0].A_index = 0; faces[0].B_index = 1; faces[0].C_index = 2;
+    faces[1].A_index = 0; faces[1].B_index = 2; faces[1].C_index = 3;
+    for (auto& face : faces)
+        face.nA_index = face.nB_index = face.nC_index = 0;
+    s.add_light(make_shared<object>(std::move(corners), std::move(down), std::move(faces),
+                                    make_shared<diffuse_light>(color(4, 4, 5))));
+
+    camera cam;
+    cam.aspect_ratio      = 16.0 / 9.0;
+    cam.image_width       = 400;
+    cam.samples_per_pixel = 64;
+    cam.max_depth         = 20;
+    cam.vfov     = 45;
+    cam.lookfrom = point3(0, 2, 6);
+    cam.lookat   = point3(0, 0.6, 0);
+    cam.vup      = vec3(0, 1, 0);
+    cam.lights   = s.lights;
+    cam.sky_brightness = 0.02;
+    s.cameras.push_back(cam);
+
+    return s;
+}
+
+/**
+ * @brief Builds a wavy, finely subdivided wall of about the given number of triangles.
+ *
+ * The wall faces +Z, spans [-half_width, half_width] in X and [0, height] in Y at depth z, and
+ * is displaced along Z by a few sine waves, with analytic vertex normals.
+ */
+inline shared_ptr<object> make_wavy_wall(size_t triangles, double half_width, double height, double z,
+                                         shared_ptr<material> mat) {
+    // A grid of columns x rows quads, two triangles each, with square cells
+    double aspect = 2 * half_width / height;
+    int rows = std::max(1, static_cast<int>(std::sqrt(triangles / (2 * aspect))));
+    int columns = std::max(1, static_cast<int>(triangles / (2.0 * rows)));
+
+    std::vector<point3> vertices;
+    std::vector<vec3> normals;
+    vertices.reserve(static_cast<size_t>(rows + 1) * (columns + 1));
+    normals.reserve(vertices.capacity());
+
+    for (int j = 0; j <= rows; j++) {
+        for (int i = 0; i <= columns; i++) {
+            double x = -half_width + 2 * half_width * i / columns;
+            double y = height * j / rows;
+            double depth = 0.4 * sin(1.3 * x) * cos(0.9 * y) + 0.1 * sin(7 * x + 5 * y);
+            double dx = 0.4 * 1.3 * cos(1.3 * x) * cos(0.9 * y) + 0.1 * 7 * cos(7 * x + 5 * y);
+            double dy = -0.4 * 0.9 * sin(1.3 * x) * sin(0.9 * y) + 0.1 * 5 * cos(7 * x + 5 * y);
+            vertices.push_back(point3(x, y, z + depth));
+            normals.push_back(unit_vector(vec3(-dx, -dy, 1)));
+        }
+    }
+
+    std::vector<face_data> faces;
+    faces.reserve(static_cast<size_t>(rows) * columns * 2);
+    auto add_face = [&faces](int a, int b, int c) {
+        face_data face;
+        face.A_index = face.nA_index = a;
+        face.B_index = face.nB_index = b;
+        face.C_index = face.nC_index = c;
+        faces.push_back(face);
+    };
+    for (int j = 0; j < rows; j++) {
+        for (int i = 0; i < columns; i++) {
+            int corner = j * (columns + 1) + i;
+            add_face(corner, corner + 1, corner + columns + 2);
+            add_face(corner, corner + columns + 2, corner + columns + 1);
+        }
+    }
+
+    return make_shared<object>(std::move(vertices), std::move(normals), std::move(faces), mat);
+}
+
+/**
+ * @brief A procedurally generated still for stress testing: many spheres, many stars and a large
+ * mesh, laid out from a seed.
+ *
+ * The spheres lie on a large ground, in a square whose area grows with their number, with the
+ * mix of diffuse, metal and glass materials of Ray Tracing in One Weekend's final scene. The
+ * stars are instances of a single loaded 20facestar.obj, floating above them, and the mesh is a
+ * wavy wall behind everything.
+ *
+ * @param sphere_count the number of random spheres
+ * @param star_count the number of star instances
+ * @param mesh_triangles the approximate number of triangles of the wall, 0 for none
+ * @param seed the seed of the layout
+ * @param resource_dir the directory holding the .obj files
+ */
+inline scene stress_scene(int sphere_count, int star_count, size_t mesh_triangles, uint32_t seed = 1,
+                          const std::string& resource_dir = "../resources") {
+    scene s;
+    s.name = "stress";
+
+    // Layout generator, independent from random_double so rendering does not change the scene
+    uint64_t state = seed * 2654435761ULL + 1;
+    auto next = [&state]() {
+        state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+        return (state >> 11) * (1.0 / 9007199254740992.0);
+    };
+
+    const int placed = std::max(1, sphere_count + star_count);
+    const double half_size = std::max(4.0, std::sqrt(static_cast<double>(placed)) * 0.8);
+
+    s.world.add(make_shared<sphere>(point3(0, -1000, 0), 1000, make_shared<lambertian>(color(0.5, 0.5, 0.5))));
+
+    auto glass = make_shared<dielectric>(1.5);
+    for (int k = 0; k < sphere_count; k++) {
+        double radius = 0.15 + 0.15 * next();
+        point3 center(half_size * (2 * next() - 1), radius, half_size * (2 * next() - 1));
+
+        double choose_mat = next();
+        shared_ptr<material> mat;
+        if (choose_mat < 0.8) {
+            mat = make_shared<lambertian>(color(next() * next(), next() * next(), next() * next()));
+        } else if (choose_mat < 0.95) {
+            mat = make_shared<metal>(color(0.5 + 0.5 * next(), 0.5 + 0.5 * next(), 0.5 + 0.5 * next()), 0.5 * next());
+        } else {
+            mat = glass;
+        }
+        auto ball = make_shared<sphere>(center, radius, mat);
+        ball->opaque = mat != glass;
+        s.world.add(ball);
+    }
+
+    if (star_count > 0) {
+        auto gold = make_shared<metal>(color(0.8, 0.6, 0.2), 0.3);
+        auto star = make_shared<object>(resource_dir + "/20facestar.obj", gold, 0.3, vec3(), vec3(-90, 0, 0));
+        for (int k = 0; k < star_count; k++) {
+            vec3 offset(half_size * (2 * next() - 1), 1 + 2 * next(), half_size * (2 * next() - 1));
+            s.world.add(make_shared<instance>(star, offset, 360 * next()));
+        }
+    }
+
+    if (mesh_triangles > 0)
+        s.world.add(make_wavy_wall(mesh_triangles, half_size, half_size, -half_size - 2,
+                                   make_shared<lambertian>(color(0.4, 0.5, 0.6))));
+
+    camera cam;
+    cam.aspect_ratio      = 16.0 / 9.0;
+    cam.image_width       = 640;
+    cam.samples_per_pixel = 16;
+    cam.max_depth         = 20;
+    cam.vfov     = 60;
+    cam.lookfrom = point3(0, 0.6 * half_size + 2, half_size + 6);
+    cam.lookat   = point3(0, 1, 0);
+    cam.vup      = vec3(0, 1, 0);
+    s.cameras.push_back(cam);
+
+    return s;
+}
+
+#endif
@@ -0,0 +1,268 @@
+/**
+ * @file temporal_accumulator.h
+ * @brief Contains the temporal_accumulator class, which carries the samples of a frame over to the next one
+ */
+#ifndef TEMPORAL_ACCUMULATOR_H
+#define TEMPORAL_ACCUMULATOR_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "util/rtweekend.h"
+#include "hdr_framebuffer.h"
+#include "feature_buffer.h"
+
+/**
+ * @brief Where a camera was and how its pixels were laid out, enough to find the pixel a point
+ * was seen in.
+ *
+ * @param center The camera center.
+ * @param pixel00 The location of pixel 0, 0 on the viewport.
+ * @param delta_u The offset to the pixel to the right.
+ * @param delta_v The offset to the pixel below.
+ * @param width The width of the image in pixels.
+ * @param height The height of the image in pixels.
+ */
+struct camera_view {
+    point3 center;
+    point3 pixel00;
+    vec3   delta_u, delta_v;
+    int    width = 0, height = 0;
+
+    /**
+     * @return the unit direction from the center through the center of pixel i, j
+     */
+    vec3 direction(int i, int j) const { return unit_vector(pixel00 + i * delta_u + j * delta_v - center); }
+
+    /**
+     * Finds where the line from the center to p crosses the viewport.
+     *
+     * @param x, y receive the pixel coordinates of the crossing, integers at pixel centers
+     * @return false if p is behind the camera
+     */
+    bool project(const point3& p, double& x, double& y) const {
+        vec3 forward = cross(delta_u, delta_v); // Into the scene, as u points right and v down
+        double along = dot(p - center, forward);
+        if (along <= 0) return false;
+
+        point3 on_viewport = center + (p - center) * (dot(pixel00 - center, forward) / along);
+        vec3 offset = on_viewport - pixel00;
+        x = dot(offset, delta_u) / delta_u.length_squared();
+        y = dot(offset, delta_v) / delta_v.length_squared();
+        return true;
+    }
+};
+
+/**
+ * @class temporal_accumulator
+ * @brief Reuses the samples of the previous frame of an animation in the current one.
+ *
+ * After a frame is rendered, every pixel looks up what it saw first, a point of the scene, in
+ * the previous frame: the point, at the pixel's mean depth along the ray through its center, is
+ * projected into the previous camera and the four pixels around it are read with bilinear
+ * weights. Still cameras thus read back exactly the same pixel, without the blur of resampling.
+ *
+ * A pixel of the previous frame is only used if it saw the same surface: the distance of the
+ * point to the previous camera and the normal of the pixel must match those of the previous
+ * pixel, within the tolerances. Otherwise the point was hidden or off screen (a disocclusion) and
+ * the pixel starts over. Pixels on the edges of objects mix two surfaces in proportions that
+ * change with every frame's few samples, so they rarely match; when the point falls on a whole
+ * previous pixel, as it does for a still camera, it is enough that it lies within the range of
+ * that pixel and its 3x3 neighbors, which keeps still edges converging. A moving camera reads
+ * between pixels, and blending history across an edge would blur it a little more every frame,
+ * so there edges start over.
+ *
+ * Lighting can change where the geometry does not, as moving objects cast their shadows and the
+ * camera sees other reflections, so the history is also clipped to the mean plus or minus
+ * clip_deviations standard deviations of the fresh samples of the pixel and its 3x3 neighbors,
+ * as in temporal antialiasing. The history is then added to the pixel as if its samples had been
+ * taken again, blending it with the fresh samples by their counts, and capped at max_history
+ * samples so changes fade in within a few frames.
+ *
+ * The frames must all have the same resolution; a new resolution, or reset, starts over.
+ *
+ * @param max_history The most samples a pixel carries over from the previous frames.
+ * @param depth_tolerance The difference in distance to the camera, as a fraction of it, allowed for a pixel to see the same surface.
+ * @param normal_tolerance The difference of each normal coordinate allowed for a pixel to see the same surface.
+ * @param clip_deviations The standard deviations of the fresh samples around their mean that the history is clipped to.
+ */
+class temporal_accumulator {
+  public:
+    int    max_history      = 32;
+    double depth_tolerance  = 0.05;
+    double normal_tolerance = 0.2;
+    double clip_deviations  = 1.0;
+
+    /**
+     * Adds the reprojected history to the radiance of the frame just rendered, then keeps the
+     * result as the history of the next frame.
+     *
+     * @param radiance the fresh samples of the frame, which receive the history
+     * @param features the averaged first hits of the frame
+     * @param view the camera the frame was rendered from
+     */
+    void accumulate(hdr_framebuffer& radiance, const feature_buffer& features, const camera_view& view) {
+        if (has_history && previous_view.width == view.width && previous_view.height == view.height)
+            reproject(radiance, features, view);
+
+        previous_radiance = radiance;
+        previous_features = features;
+        previous_view = view;
+        for (int c = 0; c < surface_channels; c++)
+            neighbor_range(features.plane(surface(c)), view.width, view.height, previous_low[c], previous_high[c]);
+        has_history = true;
+    }
+
+    /**
+     * Forgets the history, so the next frame starts over, as after a cut.
+     */
+    void reset() { has_history = false; }
+
+  private:
+    static constexpr int surface_channels = 4; // Depth and the normal coordinates
+
+    bool has_history = false;
+    hdr_framebuffer previous_radiance;
+    feature_buffer previous_features;
+    camera_view previous_view;
+    std::vector<float> previous_low[surface_channels];  // Smallest depth and normal of each 3x3 neighborhood
+    std::vector<float> previous_high[surface_channels]; // Largest depth and normal of each 3x3 neighborhood
+
+    /**
+     * @return the feature of the c-th surface channel: the depth, then the normal coordinates
+     */
+    static feature_buffer::channel surface(int c) {
+        return c == 0 ? feature_buffer::depth : static_cast<feature_buffer::channel>(feature_buffer::normal_x + c - 1);
+    }
+
+    void reproject(hdr_framebuffer& radiance, const feature_buffer& features, const camera_view& view) const {
+        const int width = view.width, height = view.height;
+        std::vector<color> low, high;
+        fresh_bounds(radiance, low, high);
+
+        const float* depth = features.plane(feature_buffer::depth);
+        const float* normal[3] = {
+            features.plane(feature_buffer::normal_x),
+            features.plane(feature_buffer::normal_y),
+            features.plane(feature_buffer::normal_z),
+        };
+        const float* previous[surface_channels];
+        for (int c = 0; c < surface_channels; c++) previous[c] = previous_features.plane(surface(c));
+
+        for (int j = 0; j < height; j++) {
+            for (int i = 0; i < width; i++) {
+                size_t k = static_cast<size_t>(j) * width + i;
+                point3 p = view.center + static_cast<double>(depth[k]) * view.direction(i, j);
+                double x, y;
+                if (!previous_view.project(p, x, y)) continue;
+
+                const float expected[surface_channels] = {
+                    static_cast<float>((p - previous_view.center).length()), normal[0][k], normal[1][k], normal[2][k],
+                };
+                const float tolerance[surface_channels] = {
+                    static_cast<float>(depth_tolerance) * expected[0], static_cast<float>(normal_tolerance),
+                    static_cast<float>(normal_tolerance), static_cast<float>(normal_tolerance),
+                };
+
+                bool whole_pixel = std::fabs(x - std::round(x)) < 1e-3 && std::fabs(y - std::round(y)) < 1e-3;
+                if (whole_pixel) {
+                    x = std::round(x);
+                    y = std::round(y);
+                }
+                int x0 = static_cast<int>(std::floor(x)), y0 = static_cast<int>(std::floor(y));
+                double fx = x - x0, fy = y - y0;
+
+                color mean(0,0,0);
+                double samples = 0, weights = 0;
+                for (int tap = 0; tap < 4; tap++) {
+                    int px = x0 + (tap & 1), py = y0 + (tap >> 1);
+                    if (px < 0 || px >= width || py < 0 || py >= height) continue;
+
+                    size_t q = static_cast<size_t>(py) * width + px;
+                    bool same_surface = true;
+                    for (int c = 0; c < surface_channels; c++) {
+                        if (whole_pixel)
+                            same_surface = same_surface && expected[c] >= previous_low[c][q] - tolerance[c]
+                                                        && expected[c] <= previous_high[c][q] + tolerance[c];
+                        else
+                            same_surface = same_surface && std::fabs(expected[c] - previous[c][q]) <= tolerance[c];
+                    }
+                    if (!same_surface) continue;
+
+                    double w = ((tap & 1) ? fx : 1 - fx) * ((tap >> 1) ? fy : 1 - fy);
+                    mean += w * previous_radiance.average(px, py);
+                    samples += w * previous_radiance.sample_count(px, py);
+                    weights += w;
+                }
+
+                // Taps that barely touch the point are not worth their lag
+                if (weights < 0.25) continue;
+                uint32_t n = static_cast<uint32_t>(std::min(samples / weights + 0.5, static_cast<double>(max_history)));
+                if (n == 0) continue;
+
+                color history = mean / weights;
+                history = color(std::min(std::max(history.x(), low[k].x()), high[k].x()),
+                                std::min(std::max(history.y(), low[k].y()), high[k].y()),
+                                std::min(std::max(history.z(), low[k].z()), high[k].z()));
+                radiance.add_samples(i, j, history, n);
+            }
+        }
+    }
+
+    /**
+     * Finds, for every pixel, the smallest and largest value of a plane over the pixel and its
+     * 3x3 neighbors.
+     */
+    static void neighbor_range(const float* plane, int width, int height, std::vector<float>& low, std::vector<float>& high) {
+        low.resize(static_cast<size_t>(width) * height);
+        high.resize(low.size());
+        for (int j = 0; j < height; j++) {
+            for (int i = 0; i < width; i++) {
+                float smallest = plane[static_cast<size_t>(j) * width + i], largest = smallest;
+                for (int y = std::max(j - 1, 0); y <= std::min(j + 1, height - 1); y++) {
+                    for (int x = std::max(i - 1, 0); x <= std::min(i + 1, width - 1); x++) {
+                        smallest = std::min(smallest, plane[static_cast<size_t>(y) * width + x]);
+                        largest = std::max(largest, plane[static_cast<size_t>(y) * width + x]);
+                    }
+                }
+                low[static_cast<size_t>(j) * width + i] = smallest;
+                high[static_cast<size_t>(j) * width + i] = largest;
+            }
+        }
+    }
+
+    /**
+     * Finds, for every pixel, the range of colors its fresh samples and their 3x3 neighbors make
+     * plausible: their mean plus or minus clip_deviations standard deviations.
+     */
+    void fresh_bounds(const hdr_framebuffer& radiance, std::vector<color>& low, std::vector<color>& high) const {
+        const int width = radiance.get_width(), height = radiance.get_height();
+        low.resize(static_cast<size_t>(width) * height);
+        high.resize(low.size());
+        for (int j = 0; j < height; j++) {
+            for (int i = 0; i < width; i++) {
+                color sum(0,0,0), squares(0,0,0);
+                int n = 0;
+                for (int y = std::max(j - 1, 0); y <= std::min(j + 1, height - 1); y++) {
+                    for (int x = std::max(i - 1, 0); x <= std::min(i + 1, width - 1); x++) {
+                        color c = radiance.average(x, y);
+                        sum += c;
+                        squares += c * c;
+                        n++;
+                    }
+                }
+                color mean = sum / n;
+                color variance = squares / n - mean * mean;
+                color deviation(std::sqrt(std::max(variance.x(), 0.0)), std::sqrt(std::max(variance.y(), 0.0)),
+                                std::sqrt(std::max(variance.z(), 0.0)));
+                size_t k = static_cast<size_t>(j) * width + i;
+                low[k] = mean - clip_deviations * deviation;
+                high[k] = mean + clip_deviations * deviation;
+            }
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,179 @@
+/**
+ * @file render_stats.h
+ * @brief Contains thread local render counters that are merged into per frame statistics
+ */
+#ifndef RENDER_STATS_H
+#define RENDER_STATS_H
+
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+/**
+ * @class render_counters
+ * @brief Ray and intersection counts gathered while rendering.
+ *
+ * The path depth histogram counts, for every camera sample, how many times the path bounced
+ * before it ended. The last bin also holds every longer path.
+ */
+class render_counters {
+  public:
+    static const int depth_bins = 64;
+
+    uint64_t primary_rays    = 0; // Camera rays
+    uint64_t secondary_rays  = 0; // Rays spawned by scattering
+    uint64_t shadow_rays     = 0; // Rays sent toward lights
+    uint64_t primitive_tests = 0; // Ray-sphere and ray-triangle tests
+    uint64_t primitive_hits  = 0; // Tests that found an intersection
+    uint64_t depth_histogram[depth_bins] = {};
+
+    void add(const render_counters& other) {
+        primary_rays += other.primary_rays;
+        secondary_rays += other.secondary_rays;
+        shadow_rays += other.shadow_rays;
+        primitive_tests += other.primitive_tests;
+        primitive_hits += other.primitive_hits;
+        for (int k = 0; k < depth_bins; k++)
+            depth_histogram[k] += other.depth_histogram[k];
+    }
+
+    void reset() { *this = render_counters(); }
+
+    uint64_t total_rays() const { return primary_rays + secondary_rays + shadow_rays; }
+
+    double tests_per_ray() const {
+        return total_rays() == 0 ? 0.0 : double(primitive_tests) / total_rays();
+    }
+
+    double mean_depth() const {
+        uint64_t paths = 0, bounces = 0;
+        for (int k = 0; k < depth_bins; k++) {
+            paths += depth_histogram[k];
+            bounces += depth_histogram[k] * k;
+        }
+        return paths == 0 ? 0.0 : double(bounces) / paths;
+    }
+
+    /**
+     * Writes a human readable summary: ray throughput, tests and hits per ray and the share of
+     * paths ending at each depth. The JSON output keeps the full histogram.
+     *
+     * @param seconds the wall time the counted work took, used for the rays per second
+     */
+    void write_summary(std::ostream& out, double seconds) const {
+        uint64_t paths = 0;
+        for (int k = 0; k < depth_bins; k++)
+            paths += depth_histogram[k];
+
+        out << "Rays: " << primary_rays << " primary, " << secondary_rays << " secondary, " << shadow_rays << " shadow, "
+            << (seconds > 0 ? total_rays() / seconds / 1e6 : 0.0) << " Mrays/s. "
+            << "Tests per ray: " << tests_per_ray() << ", hits per ray: "
+            << (total_rays() == 0 ? 0.0 : double(primitive_hits) / total_rays()) << ". "
+            << "Mean path depth: " << mean_depth() << std::endl;
+
+        // Deep paths are rare, so they share the last printed bin
+        const int printed_bins = 8;
+        uint64_t deeper = 0;
+        for (int k = printed_bins; k < depth_bins; k++)
+            deeper += depth_histogram[k];
+
+        out << "Path depth:";
+        for (int k = 0; k < printed_bins; k++)
+            out << ' ' << k << ':' << (paths ? 100.0 * depth_histogram[k] / paths : 0.0) << '%';
+        out << ' ' << printed_bins << "+:" << (paths ? 100.0 * deeper / paths : 0.0) << '%' << std::endl;
+    }
+
+    /**
+     * Writes the counters as JSON object members, without the braces, so callers can add their
+     * own fields to the same object.
+     */
+    void write_json_fields(std::ostream& out) const {
+        out << "\"primary_rays\":" << primary_rays
+            << ",\"secondary_rays\":" << secondary_rays
+            << ",\"shadow_rays\":" << shadow_rays
+            << ",\"primitive_tests\":" << primitive_tests
+            << ",\"primitive_hits\":" << primitive_hits
+            << ",\"depth_histogram\":[";
+        int last = depth_bins - 1;
+        while (last > 0 && depth_histogram[last] == 0) last--;
+        for (int k = 0; k <= last; k++)
+            out << (k ? "," : "") << depth_histogram[k];
+        out << "]";
+    }
+};
+
+/**
+ * @class render_stats
+ * @brief Gives each thread its own render_counters and merges them on demand.
+ *
+ * Counting is a plain increment on a thread local object, so it costs no synchronization. The
+ * counters of every thread are registered once; collect sums and resets them, and must only be
+ * called while no thread is rendering, such as at the end of a frame.
+ */
+class render_stats {
+  public:
+    static render_counters& local() {
+        thread_local slot current;
+        return current.counters;
+    }
+
+    static void count_primary_ray()   { local().primary_rays++; }
+    static void count_secondary_ray() { local().secondary_rays++; }
+    static void count_shadow_ray()    { local().shadow_rays++; }
+    static void count_test()          { local().primitive_tests++; }
+    static void count_hit()           { local().primitive_hits++; }
+
+    static void count_path(int depth) {
+        local().depth_histogram[depth < render_counters::depth_bins ? depth : render_counters::depth_bins - 1]++;
+    }
+
+    /**
+     * @return the sum of the counters of all threads since the last call
+     */
+    static render_counters collect() {
+        std::lock_guard<std::mutex> lock(registry().mutex);
+        render_counters total = registry().retired;
+        registry().retired.reset();
+        for (render_counters* counters : registry().live) {
+            total.add(*counters);
+            counters->reset();
+        }
+        return total;
+    }
+
+  private:
+    struct shared_registry {
+        std::mutex mutex;
+        std::vector<render_counters*> live;
+        render_counters retired; // Counts of threads that already exited
+    };
+
+    static shared_registry& registry() {
+        static shared_registry instance;
+        return instance;
+    }
+
+    struct slot {
+        render_counters counters;
+
+        slot() {
+            std::lock_guard<std::mutex> lock(registry().mutex);
+            registry().live.push_back(&counters);
+        }
+
+        ~slot() {
+            std::lock_guard<std::mutex> lock(registry().mutex);
+            registry().retired.add(counters);
+            auto& live = registry().live;
+            for (size_t k = 0; k < live.size(); k++) {
+                if (live[k] == &counters) {
+                    live.erase(live.begin() + k);
+                    break;
+                }
+            }
+        }
+    };
+};
+
+#endif
@@ -5,7 +5,9 @@
 #ifndef RTWEEKEND_H
 #define RTWEEKEND_H
 
+#include <algorithm>
 #include <cmath>
+#include <cstdint>
 #include <limits>
 #include <memory>
 
@@ -24,9 +26,75 @@ inline double degrees_to_radians(double degrees) {
     return degrees * pi / 180.0;
 }
 
+/**
+ * @return sin(2 pi t) for t in [0, 1.25), within 1e-9
+ *
+ * The angle is folded into [0, pi/2] and a Taylor polynomial is evaluated, without branches, so
+ * it is several times faster than std::sin and vectorizes in loops.
+ */
+inline double sin_2pi(double t) {
+    double x = t - static_cast<int>(t + 0.5); // [-0.5, 0.5)
+    double a = std::abs(x);
+    a = std::min(a, 0.5 - a);                 // sin(2 pi a) = sin(pi - 2 pi a), a in [0, 0.25]
+    double theta = 2 * pi * a;
+    double t2 = theta * theta;
+    double s = theta * (1 + t2 * (-1.0 / 6 + t2 * (1.0 / 120 + t2 * (-1.0 / 5040 + t2 * (1.0 / 362880
+                 + t2 * (-1.0 / 39916800 + t2 * (1.0 / 6227020800)))))));
+    return std::copysign(s, x);
+}
+
+/**
+ * @return cos(2 pi t) for t in [0, 1), within 1e-9
+ */
+inline double cos_2pi(double t) { return sin_2pi(t + 0.25); }
+
+/**
+ * @return the state of the calling thread's random number generator
+ *
+ * Every thread has its own generator, so threads never share or lock a state.
+ */
+inline uint64_t& random_state() {
+    thread_local uint64_t state = 0x853c49e6748fea9bULL;
+    return state;
+}
+
+/**
+ * @brief Mixes the bits of a 64 bit value (the SplitMix64 finalizer)
+ */
+inline uint64_t hash_uint64(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+/**
+ * @brief Restarts the calling thread's generator from a seed.
+ *
+ * The renderer seeds the generator from the pixel and sample being computed, so the image does
+ * not depend on which thread renders which pixel.
+ */
+inline void seed_random(uint64_t seed) {
+    random_state() = hash_uint64(seed + 0x9e3779b97f4a7c15ULL);
+}
+
+/**
+ * @return a random 32 bit integer from the calling thread's PCG32 generator
+ */
+inline uint32_t random_uint32() {
+    uint64_t& state = random_state();
+    uint64_t old = state;
+    state = old * 6364136223846793005ULL + 1442695040888963407ULL;
+    uint32_t xorshifted = static_cast<uint32_t>(((old >> 18) ^ old) >> 27);
+    uint32_t rotation = static_cast<uint32_t>(old >> 59);
+    return (xorshifted >> rotation) | (xorshifted << ((32 - rotation) & 31));
+}
+
 inline double random_double() {
     // Returns a random real in [0,1).
-    return rand() / (RAND_MAX + 1.0);
+    return random_uint32() * (1.0 / 4294967296.0);
 }
 
 inline double random_double(double min, double max) {
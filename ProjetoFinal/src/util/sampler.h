@@ -0,0 +1,330 @@
+/**
+ * @file sampler.h
+ * @brief Contains the sampler classes, which supply the random numbers of each pixel sample
+ *
+ * Every sample of a pixel consumes a sequence of dimensions: two for the position inside the pixel,
+ * then one or two for each bounce. A sampler returns the value of any (pixel, sample, dimension),
+ * so the numbers can come from a low discrepancy sequence instead of independent random numbers,
+ * which fills each dimension more evenly and converges faster.
+ */
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "rtweekend.h"
+
+/**
+ * @brief The sequences a camera can sample pixels with.
+ */
+enum sampler_kind {
+    sampler_independent = 0, // Independent uniform random numbers
+    sampler_sobol,           // Sobol (0,2) pairs, Owen scrambled and shuffled per pixel and dimension
+    sampler_halton,          // Halton, with the digits scrambled per pixel
+    sampler_blue_noise       // Sobol pairs shared by all pixels, shifted per pixel by a blue noise mask
+};
+
+/**
+ * @brief Two sample values in [0,1), used together, like the position inside a pixel.
+ */
+struct sample_2d {
+    double u, v;
+};
+
+namespace sampler_detail {
+
+inline uint32_t reverse_bits(uint32_t x) {
+    x = (x << 16) | (x >> 16);
+    x = ((x & 0x00ff00ffu) << 8) | ((x & 0xff00ff00u) >> 8);
+    x = ((x & 0x0f0f0f0fu) << 4) | ((x & 0xf0f0f0f0u) >> 4);
+    x = ((x & 0x33333333u) << 2) | ((x & 0xccccccccu) >> 2);
+    x = ((x & 0x55555555u) << 1) | ((x & 0xaaaaaaaau) >> 1);
+    return x;
+}
+
+/**
+ * @brief An Owen scramble of the bits of x, from Burley's "Practical Hash-based Owen Scrambling"
+ *
+ * Each bit is flipped depending on the seed and on the bits above it, so the scrambled points keep
+ * the stratification of the sequence while looking random.
+ */
+inline uint32_t owen_scramble(uint32_t x, uint32_t seed) {
+    x = reverse_bits(x);
+    x += seed;
+    x ^= x * 0x6c50b47cu;
+    x ^= x * 0xb82f1e52u;
+    x ^= x * 0xc7afe638u;
+    x ^= x * 0x8d22f6e6u;
+    return reverse_bits(x);
+}
+
+/** @brief The first dimension of the Sobol sequence, the base 2 van der Corput sequence */
+inline uint32_t sobol_0(uint32_t index) { return reverse_bits(index); }
+
+/**
+ * @brief The second dimension of the Sobol sequence
+ *
+ * The result is the XOR of one direction number per set bit of the index, looked up a byte of
+ * the index at a time.
+ */
+inline uint32_t sobol_1(uint32_t index) {
+    static const std::vector<uint32_t> bytes = [] {
+        uint32_t directions[32];
+        directions[0] = 1u << 31;
+        for (int bit = 1; bit < 32; bit++)
+            directions[bit] = directions[bit - 1] ^ (directions[bit - 1] >> 1);
+
+        std::vector<uint32_t> table(4 * 256, 0);
+        for (int byte = 0; byte < 4; byte++)
+            for (int value = 0; value < 256; value++)
+                for (int bit = 0; bit < 8; bit++)
+                    if (value & (1 << bit)) table[byte * 256 + value] ^= directions[byte * 8 + bit];
+        return table;
+    }();
+    return bytes[index & 255] ^ bytes[256 + ((index >> 8) & 255)] ^ bytes[512 + ((index >> 16) & 255)]
+         ^ bytes[768 + (index >> 24)];
+}
+
+inline double to_unit(uint32_t bits) {
+    return std::min(bits * (1.0 / 4294967296.0), 1.0 - 1e-16);
+}
+
+/**
+ * @return the 2D point of index `index` of the Sobol sequence, with the index shuffled and both
+ * coordinates scrambled from the seed
+ */
+inline sample_2d scrambled_sobol_2d(uint32_t index, uint32_t seed) {
+    index = owen_scramble(index, seed);
+    uint32_t x = owen_scramble(sobol_0(index), seed ^ 0xa511e9b3u);
+    uint32_t y = owen_scramble(sobol_1(index), seed ^ 0x63d83595u);
+    return {to_unit(x), to_unit(y)};
+}
+
+/**
+ * @return the first primes, the bases of the Halton dimensions
+ */
+inline const std::vector<uint32_t>& primes() {
+    static const std::vector<uint32_t> table = [] {
+        std::vector<uint32_t> found;
+        for (uint32_t n = 2; found.size() < 256; n++) {
+            bool prime = true;
+            for (uint32_t p : found) {
+                if (p * p > n) break;
+                if (n % p == 0) { prime = false; break; }
+            }
+            if (prime) found.push_back(n);
+        }
+        return found;
+    }();
+    return table;
+}
+
+/**
+ * @return the radical inverse of index in the given base, with every digit shifted by an amount
+ * drawn from the hash and the digit position, including the zero digits past the last one, down
+ * to a precision of 2^-32
+ */
+inline double scrambled_radical_inverse(uint32_t base, uint32_t index, uint64_t hash) {
+    const double inverse_base = 1.0 / base;
+    double scale = inverse_base, result = 0;
+    uint64_t shifts = hash;
+    while (scale > 1.0 / 4294967296.0) {
+        uint32_t digit = index % base;
+        index /= base;
+        shifts = shifts * 6364136223846793005ULL + 1442695040888963407ULL;
+        uint32_t shift = static_cast<uint32_t>(((shifts >> 32) * base) >> 32);
+        uint32_t scrambled = digit + shift;
+        result += (scrambled >= base ? scrambled - base : scrambled) * scale;
+        scale *= inverse_base;
+    }
+    return std::min(result, 1.0 - 1e-16);
+}
+
+/**
+ * @brief A 64x64 tileable blue noise mask, built once with the void and cluster method
+ *
+ * Pixels are ranked by filling, one at a time, the empty pixel farthest from the ones already
+ * filled (the one with the least Gaussian energy). Neighbouring values of the mask are therefore
+ * as different as possible, which makes the error of neighbouring pixels cancel out when the mask
+ * shifts their samples.
+ *
+ * @return the mask values in [0,1), row by row
+ */
+inline const std::vector<double>& blue_noise_mask() {
+    static const std::vector<double> mask = [] {
+        const int size = 64, count = size * size;
+        const double sigma = 1.9;
+
+        // Energy that a filled pixel adds at each toroidal offset
+        std::vector<double> kernel(count);
+        for (int y = 0; y < size; y++) {
+            for (int x = 0; x < size; x++) {
+                int dx = std::min(x, size - x), dy = std::min(y, size - y);
+                kernel[y * size + x] = std::exp(-(dx * dx + dy * dy) / (2 * sigma * sigma));
+            }
+        }
+
+        // A tiny fixed jitter breaks the ties of the first, symmetric steps
+        std::vector<double> energy(count);
+        for (int k = 0; k < count; k++)
+            energy[k] = 1e-9 * (hash_uint64(k) >> 11) * (1.0 / 9007199254740992.0);
+
+        std::vector<double> values(count);
+        std::vector<bool> filled(count, false);
+        for (int rank = 0; rank < count; rank++) {
+            int best = -1;
+            for (int k = 0; k < count; k++)
+                if (!filled[k] && (best < 0 || energy[k] < energy[best])) best = k;
+
+            filled[best] = true;
+            values[best] = (rank + 0.5) / count;
+            int bx = best % size, by = best / size;
+            for (int y = 0; y < size; y++) {
+                const double* row = &kernel[((y - by + size) % size) * size];
+                for (int x = 0; x < size; x++)
+                    energy[y * size + x] += row[(x - bx + size) % size];
+            }
+        }
+        return values;
+    }();
+    return mask;
+}
+
+} // namespace sampler_detail
+
+/**
+ * @class sampler
+ * @brief Supplies the sample values of one pixel sample after another.
+ *
+ * start_sample selects the pixel and the sample index and restarts at dimension 0, and each call
+ * to get_1d or get_2d takes the next dimension. It also seeds random_double from the pixel and
+ * the sample, so code that still draws independent random numbers stays deterministic.
+ *
+ * @param seed The seed that the pixel scrambles are drawn from.
+ */
+class sampler {
+  public:
+    sampler(uint64_t _seed) : seed(_seed) {}
+    virtual ~sampler() = default;
+
+    void start_sample(int _i, int _j, int _index) {
+        i = _i;
+        j = _j;
+        index = static_cast<uint32_t>(_index);
+        dimension = 0;
+        pixel = hash_uint64(hash_uint64(seed) ^ (static_cast<uint64_t>(j) << 32 | static_cast<uint32_t>(i)));
+        seed_random(pixel + index);
+    }
+
+    virtual double get_1d() = 0;
+    virtual sample_2d get_2d() = 0;
+
+  protected:
+    uint64_t seed;
+    int i = 0, j = 0;       // Pixel
+    uint32_t index = 0;     // Sample of the pixel
+    uint32_t dimension = 0; // Next dimension
+    uint64_t pixel = 0;     // Hash of the seed and pixel
+
+    /** @return a hash of the pixel and the next dimension, advancing the dimension */
+    uint32_t next_dimension_hash() { return static_cast<uint32_t>(hash_uint64(pixel ^ hash_uint64(dimension++))); }
+};
+
+/**
+ * @class independent_sampler
+ * @brief Independent uniform random numbers, the plain Monte Carlo estimate.
+ */
+class independent_sampler : public sampler {
+  public:
+    independent_sampler(uint64_t _seed) : sampler(_seed) {}
+
+    double get_1d() override { return random_double(); }
+    sample_2d get_2d() override { return {random_double(), random_double()}; }
+};
+
+/**
+ * @class sobol_sampler
+ * @brief The first two Sobol dimensions, padded to any number of dimensions.
+ *
+ * Every request takes a point of the 2D Sobol (0,2) sequence, Owen scrambled and with its index
+ * shuffled by a hash of the pixel and dimension, so dimensions and pixels are uncorrelated while
+ * each pair stays stratified. Sample counts that are powers of 2 are stratified best.
+ */
+class sobol_sampler : public sampler {
+  public:
+    sobol_sampler(uint64_t _seed) : sampler(_seed) {}
+
+    double get_1d() override { return sampler_detail::scrambled_sobol_2d(index, next_dimension_hash()).u; }
+    sample_2d get_2d() override { return sampler_detail::scrambled_sobol_2d(index, next_dimension_hash()); }
+};
+
+/**
+ * @class halton_sampler
+ * @brief The Halton sequence, one prime base per dimension, with randomly shifted digits per pixel.
+ *
+ * Past the first 256 dimensions, which only very deep paths reach, it falls back to independent
+ * random numbers.
+ */
+class halton_sampler : public sampler {
+  public:
+    halton_sampler(uint64_t _seed) : sampler(_seed) {}
+
+    double get_1d() override {
+        const std::vector<uint32_t>& bases = sampler_detail::primes();
+        if (dimension >= bases.size()) return random_double();
+        uint32_t base = bases[dimension];
+        return sampler_detail::scrambled_radical_inverse(base, index, pixel ^ hash_uint64(dimension++));
+    }
+
+    sample_2d get_2d() override {
+        double u = get_1d();
+        return {u, get_1d()};
+    }
+};
+
+/**
+ * @class blue_noise_sampler
+ * @brief Sobol points shared by every pixel, each pixel shifted by its value in a blue noise mask.
+ *
+ * The shift (a Cranley-Patterson rotation) of each dimension reads the mask at an offset drawn
+ * from the dimension, so the error left at low sample counts is spread as high frequency noise,
+ * which looks finer than the white noise of the other samplers at the same error.
+ */
+class blue_noise_sampler : public sampler {
+  public:
+    blue_noise_sampler(uint64_t _seed) : sampler(_seed) {}
+
+    double get_1d() override { return get_2d().u; }
+
+    sample_2d get_2d() override {
+        uint64_t hash = hash_uint64(hash_uint64(seed) ^ hash_uint64(dimension++));
+        sample_2d point = sampler_detail::scrambled_sobol_2d(index, static_cast<uint32_t>(hash));
+        return {shift(point.u, hash >> 32), shift(point.v, hash >> 44)};
+    }
+
+  private:
+    double shift(double value, uint64_t offset) const {
+        const std::vector<double>& mask = sampler_detail::blue_noise_mask();
+        int x = (i + static_cast<int>(offset & 63)) & 63;
+        int y = (j + static_cast<int>((offset >> 6) & 63)) & 63;
+        value += mask[y * 64 + x];
+        return value >= 1 ? value - 1 : value;
+    }
+};
+
+/**
+ * @return a new sampler of the given kind
+ */
+inline std::unique_ptr<sampler> make_sampler(sampler_kind kind, uint64_t seed) {
+    switch (kind) {
+        case sampler_sobol:      return std::unique_ptr<sampler>(new sobol_sampler(seed));
+        case sampler_halton:     return std::unique_ptr<sampler>(new halton_sampler(seed));
+        case sampler_blue_noise: return std::unique_ptr<sampler>(new blue_noise_sampler(seed));
+        default:                 return std::unique_ptr<sampler>(new independent_sampler(seed));
+    }
+}
+
+#endif
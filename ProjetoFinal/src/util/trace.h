@@ -0,0 +1,189 @@
+/**
+ * @file trace.h
+ * @brief Contains scoped timeline events written in the Chrome trace event format
+ *
+ * Tracing only exists when the project is configured with `-DRT_ENABLE_TRACE=ON`. Otherwise the
+ * macros below expand to nothing and none of this file is compiled, so a normal build pays
+ * nothing for the instrumentation.
+ *
+ * - `TRACE_SCOPE("name")` records an event lasting until the end of the enclosing scope.
+ * - `TRACE_SCOPE_INDEX("name", n)` does the same and stores n as the event's index argument.
+ * - `TRACE_THREAD_NAME("name")` names the calling thread's track.
+ *
+ * The file written by `trace_recorder::write` can be opened in chrome://tracing or in
+ * https://ui.perfetto.dev, with one track per thread.
+ */
+#ifndef TRACE_H
+#define TRACE_H
+
+#ifdef RT_ENABLE_TRACE
+
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+ * @class trace_recorder
+ * @brief Collects finished events in per thread buffers and writes them as a JSON trace.
+ *
+ * Recording an event only appends to the calling thread's own buffer. Buffers of threads that
+ * exit are kept until the trace is written, and their track id is given to the next new thread,
+ * so short lived worker threads share a few tracks instead of adding one each.
+ */
+class trace_recorder {
+  public:
+    struct event {
+        const char* name;  // Must be a string literal
+        int64_t start;     // Microseconds since the recorder started
+        int64_t duration;  // Microseconds
+        long long index;   // Optional argument, negative when absent
+    };
+
+    static int64_t now() {
+        return std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - registry().origin).count();
+    }
+
+    static void record(const char* name, int64_t start, int64_t end, long long index) {
+        local().events.push_back(event{name, start, end - start, index});
+    }
+
+    static void name_thread(const std::string& name) {
+        track& t = local(); // Registers the thread before taking the lock
+        std::lock_guard<std::mutex> lock(registry().mutex);
+        t.name = name;
+    }
+
+    /**
+     * Writes every event recorded so far. Threads still running must not be recording.
+     *
+     * @return false if the file could not be written
+     */
+    static bool write(const std::string& path) {
+        std::ofstream out(path);
+        if (!out) {
+            std::cerr << "Error: Could not open " << path << std::endl;
+            return false;
+        }
+
+        std::lock_guard<std::mutex> lock(registry().mutex);
+        out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+        bool first = true;
+        auto write_track = [&](const track& t) {
+            if (!t.name.empty()) {
+                out << (first ? "" : ",\n") << "{\"ph\":\"M\",\"pid\":1,\"tid\":" << t.id
+                    << ",\"name\":\"thread_name\",\"args\":{\"name\":\"" << t.name << "\"}}";
+                first = false;
+            }
+            for (const event& e : t.events) {
+                out << (first ? "" : ",\n") << "{\"ph\":\"X\",\"pid\":1,\"tid\":" << t.id
+                    << ",\"name\":\"" << e.name << "\",\"ts\":" << e.start << ",\"dur\":" << e.duration;
+                if (e.index >= 0)
+                    out << ",\"args\":{\"index\":" << e.index << "}";
+                out << "}";
+                first = false;
+            }
+        };
+        for (const track& t : registry().finished)
+            write_track(t);
+        for (const track* t : registry().live)
+            write_track(*t);
+        out << "\n]}\n";
+        return static_cast<bool>(out);
+    }
+
+  private:
+    struct track {
+        int id = 0;
+        std::string name;
+        std::vector<event> events;
+    };
+
+    struct shared_registry {
+        std::mutex mutex;
+        std::chrono::steady_clock::time_point origin = std::chrono::steady_clock::now();
+        std::vector<track*> live;
+        std::vector<track> finished; // Tracks of threads that already exited
+        std::vector<int> free_ids;   // Ids of finished tracks, reused by new threads
+        int next_id = 1;
+    };
+
+    static shared_registry& registry() {
+        static shared_registry instance;
+        return instance;
+    }
+
+    struct slot {
+        track t;
+
+        slot() {
+            std::lock_guard<std::mutex> lock(registry().mutex);
+            auto& free_ids = registry().free_ids;
+            if (free_ids.empty()) {
+                t.id = registry().next_id++;
+            } else {
+                t.id = free_ids.back();
+                free_ids.pop_back();
+            }
+            registry().live.push_back(&t);
+        }
+
+        ~slot() {
+            std::lock_guard<std::mutex> lock(registry().mutex);
+            auto& live = registry().live;
+            for (size_t k = 0; k < live.size(); k++) {
+                if (live[k] == &t) {
+                    live.erase(live.begin() + k);
+                    break;
+                }
+            }
+            registry().free_ids.push_back(t.id);
+            registry().finished.push_back(std::move(t));
+        }
+    };
+
+    static track& local() {
+        thread_local slot current;
+        return current.t;
+    }
+};
+
+/**
+ * @class trace_scope
+ * @brief Records an event from its construction to its destruction.
+ */
+class trace_scope {
+  public:
+    trace_scope(const char* _name, long long _index = -1)
+      : name(_name), index(_index), start(trace_recorder::now()) {}
+
+    ~trace_scope() { trace_recorder::record(name, start, trace_recorder::now(), index); }
+
+    trace_scope(const trace_scope&) = delete;
+    trace_scope& operator=(const trace_scope&) = delete;
+
+  private:
+    const char* name;
+    long long index;
+    int64_t start;
+};
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+#define TRACE_SCOPE(name) trace_scope TRACE_CONCAT(trace_scope_, __LINE__)(name)
+#define TRACE_SCOPE_INDEX(name, index) trace_scope TRACE_CONCAT(trace_scope_, __LINE__)(name, index)
+#define TRACE_THREAD_NAME(name) trace_recorder::name_thread(name)
+
+#else
+
+#define TRACE_SCOPE(name) do {} while (0)
+#define TRACE_SCOPE_INDEX(name, index) do {} while (0)
+#define TRACE_THREAD_NAME(name) do {} while (0)
+
+#endif
+
+#endif
@@ -0,0 +1,150 @@
+/**
+ * @file y4m_writer.h
+ * @brief Contains the y4m_writer class, which streams frames as uncompressed YUV4MPEG2 video
+ */
+#ifndef Y4M_WRITER_H
+#define Y4M_WRITER_H
+
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "framebuffer.h"
+
+/**
+ * @brief Converts packed 8 bit RGB pixels to planar BT.601 limited range YUV 4:4:4.
+ *
+ * Uses the usual 8 bit fixed point approximation
+ * Y = ((66R + 129G + 25B + 128) >> 8) + 16,
+ * U = ((-38R - 74G + 112B + 128) >> 8) + 128,
+ * V = ((112R - 94G - 18B + 128) >> 8) + 128.
+ * With SSE2, eight pixels are converted per iteration in 16 bit lanes; every intermediate value
+ * fits in 16 bits, unsigned for Y and signed for U and V.
+ *
+ * @param rgb The packed RGB input.
+ * @param count The number of pixels.
+ * @param y The luma plane output.
+ * @param u The blue difference plane output.
+ * @param v The red difference plane output.
+ */
+inline void rgb_to_yuv444(const unsigned char* rgb, size_t count, unsigned char* y, unsigned char* u, unsigned char* v) {
+    size_t k = 0;
+
+#ifdef __SSE2__
+    const __m128i c66 = _mm_set1_epi16(66), c129 = _mm_set1_epi16(129), c25 = _mm_set1_epi16(25);
+    const __m128i c38 = _mm_set1_epi16(38), c74 = _mm_set1_epi16(74), c112 = _mm_set1_epi16(112);
+    const __m128i c94 = _mm_set1_epi16(94), c18 = _mm_set1_epi16(18);
+    const __m128i round = _mm_set1_epi16(128), luma_offset = _mm_set1_epi16(16);
+
+    for (; k + 8 <= count; k += 8) {
+        const unsigned char* p = rgb + k * 3;
+        __m128i r = _mm_setr_epi16(p[0], p[3], p[6], p[9], p[12], p[15], p[18], p[21]);
+        __m128i g = _mm_setr_epi16(p[1], p[4], p[7], p[10], p[13], p[16], p[19], p[22]);
+        __m128i b = _mm_setr_epi16(p[2], p[5], p[8], p[11], p[14], p[17], p[20], p[23]);
+
+        __m128i luma = _mm_add_epi16(_mm_mullo_epi16(r, c66), _mm_mullo_epi16(g, c129));
+        luma = _mm_add_epi16(_mm_add_epi16(luma, _mm_mullo_epi16(b, c25)), round);
+        luma = _mm_add_epi16(_mm_srli_epi16(luma, 8), luma_offset);
+
+        __m128i cb = _mm_sub_epi16(_mm_mullo_epi16(b, c112), _mm_mullo_epi16(r, c38));
+        cb = _mm_add_epi16(_mm_sub_epi16(cb, _mm_mullo_epi16(g, c74)), round);
+        cb = _mm_add_epi16(_mm_srai_epi16(cb, 8), round);
+
+        __m128i cr = _mm_sub_epi16(_mm_mullo_epi16(r, c112), _mm_mullo_epi16(g, c94));
+        cr = _mm_add_epi16(_mm_sub_epi16(cr, _mm_mullo_epi16(b, c18)), round);
+        cr = _mm_add_epi16(_mm_srai_epi16(cr, 8), round);
+
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(y + k), _mm_packus_epi16(luma, luma));
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(u + k), _mm_packus_epi16(cb, cb));
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(v + k), _mm_packus_epi16(cr, cr));
+    }
+#endif
+
+    for (; k < count; k++) {
+        int r = rgb[k * 3], g = rgb[k * 3 + 1], b = rgb[k * 3 + 2];
+        y[k] = static_cast<unsigned char>(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+        u[k] = static_cast<unsigned char>(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+        v[k] = static_cast<unsigned char>(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+    }
+}
+
+/**
+ * @class y4m_writer
+ * @brief Streams frames to a YUV4MPEG2 file or to the standard output.
+ *
+ * The stream header is written with the first frame, using its size. Frames are stored as
+ * progressive 4:4:4 planes, which encoders such as ffmpeg read directly from a pipe, so no
+ * intermediate image files are needed.
+ *
+ * @param path The output file, or "-" for the standard output.
+ * @param frames_per_second The frame rate written to the stream header.
+ */
+class y4m_writer {
+  public:
+    y4m_writer(std::string path, int _frames_per_second) : frames_per_second(_frames_per_second) {
+        if (path == "-") {
+            out = stdout;
+        } else {
+            out = std::fopen(path.c_str(), "wb");
+            owns_file = true;
+        }
+        if (out == nullptr)
+            std::cerr << "Error: Could not open the Y4M output: " << path << std::endl;
+    }
+
+    ~y4m_writer() { close(); }
+
+    y4m_writer(const y4m_writer&) = delete;
+    y4m_writer& operator=(const y4m_writer&) = delete;
+
+    bool is_open() const { return out != nullptr; }
+
+    /**
+     * Converts a frame to YUV and appends it to the stream.
+     *
+     * @param image the frame, which must keep the size of the first frame
+     */
+    void write_frame(const framebuffer& image) {
+        if (out == nullptr) return;
+
+        if (width == 0) {
+            width = image.get_width();
+            height = image.get_height();
+            std::fprintf(out, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C444\n", width, height, frames_per_second);
+        }
+
+        if (image.get_width() != width || image.get_height() != height) {
+            std::cerr << "Error: Y4M frames must all have the same size" << std::endl;
+            return;
+        }
+
+        const size_t pixels = static_cast<size_t>(width) * height;
+        planes.resize(pixels * 3);
+        rgb_to_yuv444(image.data(), pixels, planes.data(), planes.data() + pixels, planes.data() + 2 * pixels);
+
+        std::fputs("FRAME\n", out);
+        std::fwrite(planes.data(), 1, planes.size(), out);
+        std::fflush(out);
+    }
+
+    void close() {
+        if (out != nullptr && owns_file)
+            std::fclose(out);
+        out = nullptr;
+    }
+
+  private:
+    std::FILE* out = nullptr;
+    bool owns_file = false;
+    int frames_per_second;
+    int width = 0;
+    int height = 0;
+    std::vector<unsigned char> planes;
+};
+
+#endif
@@ -0,0 +1,93 @@
+#include <gtest/gtest.h>
+#include <fstream>
+#include <string>
+#include "util/rtweekend.h"
+#include "geometry/ply_reader.h"
+
+// Writes a binary little endian ply with the given elements and body, returning its path
+static std::string write_ply(const std::string& name, const std::string& elements, const std::string& body) {
+    std::string path = name + ".ply";
+    std::ofstream file(path, std::ios::binary);
+    file << "ply\nformat binary_little_endian 1.0\n" << elements << "end_header\n" << body;
+    return path;
+}
+
+static void read_ply(const std::string& path) {
+    std::vector<point3> vertice_list;
+    std::vector<vec3> normal_list;
+    std::vector<face_data> face_list;
+    ply_reader(path).read(vertice_list, normal_list, face_list);
+}
+
+static const std::string triangle_vertices =
+    "element vertex 3\nproperty float x\nproperty float y\nproperty float z\n";
+
+// Three float vertices, all zero
+static const std::string triangle_body(36, '\0');
+
+TEST(PlyReaderTest, Read_Cube) {
+    std::vector<point3> vertice_list;
+    std::vector<vec3> normal_list;
+    std::vector<face_data> face_list;
+    ply_reader(RESOURCES_DIR "/cube.ply").read(vertice_list, normal_list, face_list);
+    EXPECT_EQ(vertice_list.size(), 24);
+    EXPECT_EQ(face_list.size(), 12);
+}
+
+TEST(PlyReaderTest, Read_Triangle) {
+    std::string body = triangle_body + std::string("\x03\0\0\0\0\x01\0\0\0\x02\0\0\0", 13);
+    std::string path = write_ply("triangle", triangle_vertices + "element face 1\nproperty list uchar int vertex_indices\n", body);
+
+    std::vector<point3> vertice_list;
+    std::vector<vec3> normal_list;
+    std::vector<face_data> face_list;
+    ply_reader(path).read(vertice_list, normal_list, face_list);
+    EXPECT_EQ(vertice_list.size(), 3);
+    EXPECT_EQ(face_list.size(), 1);
+}
+
+TEST(PlyReaderTest, Read_TooShort) {
+    std::ofstream("short.ply", std::ios::binary) << "pl";
+    EXPECT_EXIT(read_ply("short.ply"), ::testing::ExitedWithCode(1), "Invalid ply header");
+}
+
+TEST(PlyReaderTest, Header_NegativeElementCount) {
+    std::string path = write_ply("negative_count", "element vertex -1\nproperty float x\nproperty float y\nproperty float z\n", "");
+    EXPECT_EXIT(read_ply(path), ::testing::ExitedWithCode(1), "Invalid ply element count");
+}
+
+TEST(PlyReaderTest, Header_MissingElementCount) {
+    std::string path = write_ply("missing_count", "element vertex\nproperty float x\nproperty float y\nproperty float z\n", "");
+    EXPECT_EXIT(read_ply(path), ::testing::ExitedWithCode(1), "Invalid ply element count");
+}
+
+TEST(PlyReaderTest, Header_OverflowingElementCount) {
+    // stride * count wraps around to a small number of bytes
+    std::string path = write_ply("overflowing_count",
+        "element vertex 1537228672809129302\nproperty float x\nproperty float y\nproperty float z\n", triangle_body);
+    EXPECT_EXIT(read_ply(path), ::testing::ExitedWithCode(1), "Truncated ply file");
+}
+
+TEST(PlyReaderTest, Faces_NegativeListLength) {
+    std::string path = write_ply("negative_list",
+        triangle_vertices + "element face 1\nproperty list char int vertex_indices\n", triangle_body + "\xff");
+    EXPECT_EXIT(read_ply(path), ::testing::ExitedWithCode(1), "Negative ply list length");
+}
+
+TEST(PlyReaderTest, Faces_TruncatedList) {
+    std::string body = triangle_body + std::string("\x03\0\0\0\0\x01\0\0", 9);
+    std::string path = write_ply("truncated_list", triangle_vertices + "element face 1\nproperty list uchar int vertex_indices\n", body);
+    EXPECT_EXIT(read_ply(path), ::testing::ExitedWithCode(1), "Truncated ply file");
+}
+
+TEST(PlyReaderTest, Skip_NegativeListLength) {
+    std::string path = write_ply("skip_negative_list",
+        triangle_vertices + "element edge 1\nproperty list char int vertex_indices\n", triangle_body + "\xff");
+    EXPECT_EXIT(read_ply(path), ::testing::ExitedWithCode(1), "Negative ply list length");
+}
+
+TEST(PlyReaderTest, Skip_TruncatedList) {
+    std::string path = write_ply("skip_truncated_list",
+        triangle_vertices + "element edge 1\nproperty list uchar int vertex_indices\n", triangle_body + "\x02" + std::string(4, '\0'));
+    EXPECT_EXIT(read_ply(path), ::testing::ExitedWithCode(1), "Truncated ply file");
+}